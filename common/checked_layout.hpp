@@ -0,0 +1,55 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosiolib/serialize.hpp>
+#include <eosiolib/asset.hpp>
+#include <eosiolib/time.hpp>
+
+#include "table_layouts.hpp"
+
+#include <boost/preprocessor/seq/for_each_i.hpp>
+#include <boost/preprocessor/seq/size.hpp>
+#include <boost/preprocessor/stringize.hpp>
+#include <boost/preprocessor/tuple/elem.hpp>
+#include <string>
+#include <type_traits>
+
+namespace inspace {
+
+   /** true if a record member of type Member packs the way the layout field Field reads it **/
+   template<typename Member, typename Field>
+   struct packs_as : std::is_same<Member, Field> {};
+
+   template<> struct packs_as<uint64_t, name_field> : std::true_type {};
+   template<> struct packs_as<std::string, var_string> : std::true_type {};
+   template<> struct packs_as<std::string, hash_string> : std::true_type {};
+   template<> struct packs_as<checksum256, checksum_field> : std::true_type {};
+   template<> struct packs_as<eosio::asset, asset_field> : std::true_type {};
+   template<> struct packs_as<eosio::time_point_sec, time_field> : std::true_type {};
+
+} /// namespace inspace
+
+#define EOSLIB_LAYOUT_MEMBER_CHECK( r, TYPE_LAYOUT, i, elem ) \
+   static_assert( inspace::packs_as<decltype(BOOST_PP_TUPLE_ELEM(2, 0, TYPE_LAYOUT)::elem), BOOST_PP_TUPLE_ELEM(2, 1, TYPE_LAYOUT)::field<i>>::value, \
+                  BOOST_PP_STRINGIZE(BOOST_PP_TUPLE_ELEM(2, 0, TYPE_LAYOUT)) "::" BOOST_PP_STRINGIZE(elem) " does not match field " BOOST_PP_STRINGIZE(i) " of " BOOST_PP_STRINGIZE(BOOST_PP_TUPLE_ELEM(2, 1, TYPE_LAYOUT)) );
+
+/**
+ * Checks at compile time that MEMBERS, in order, pack the way LAYOUT from
+ * table_layouts.hpp describes: the same number of fields, and each member
+ * of a type its field reads. For records with their own serializer or
+ * EOSLIB_SERIALIZE_FIXED; the others use EOSLIB_SERIALIZE_LAYOUT.
+ */
+#define EOSLIB_CHECK_LAYOUT( TYPE, LAYOUT, MEMBERS ) \
+   static_assert( LAYOUT::field_count == BOOST_PP_SEQ_SIZE(MEMBERS), #LAYOUT " does not have one field per member of " #TYPE ); \
+   BOOST_PP_SEQ_FOR_EACH_I( EOSLIB_LAYOUT_MEMBER_CHECK, (TYPE, LAYOUT), MEMBERS )
+
+/**
+ * EOSLIB_SERIALIZE for a table record, checked against the layout the
+ * native tools decode its rows with.
+ */
+#define EOSLIB_SERIALIZE_LAYOUT( TYPE, LAYOUT, MEMBERS ) \
+   EOSLIB_CHECK_LAYOUT( TYPE, LAYOUT, MEMBERS ) \
+   EOSLIB_SERIALIZE( TYPE, MEMBERS )
@@ -0,0 +1,61 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosiolib/serialize.hpp>
+#include <eosiolib/asset.hpp>
+#include <eosiolib/time.hpp>
+
+#include <boost/preprocessor/stringize.hpp>
+#include <type_traits>
+
+namespace eosio {
+
+   template<typename...> struct fixed_layout_void { typedef void type; };
+
+   /**
+    * True for types whose packed form is exactly their in-memory layout: plain
+    * integers, the fixed-size eosio types, and records declared with
+    * EOSLIB_SERIALIZE_FIXED.
+    */
+   template<typename T, typename = void>
+   struct is_fixed_layout : std::integral_constant<bool, std::is_integral<T>::value> {};
+
+   template<typename T>
+   struct is_fixed_layout<T, typename fixed_layout_void<typename T::fixed_layout_record>::type>
+      : std::is_same<typename T::fixed_layout_record, T> {};
+
+   template<> struct is_fixed_layout<symbol_type> : std::true_type {};
+   template<> struct is_fixed_layout<asset> : std::true_type {};
+   template<> struct is_fixed_layout<time_point_sec> : std::true_type {};
+   template<> struct is_fixed_layout<checksum256> : std::true_type {};
+
+} /// namespace eosio
+
+#define EOSLIB_FIXED_MEMBER_SIZE( r, TYPE, elem ) + sizeof(TYPE::elem)
+#define EOSLIB_FIXED_MEMBER_CHECK( r, TYPE, elem ) \
+   static_assert( eosio::is_fixed_layout<decltype(TYPE::elem)>::value, #TYPE "::" BOOST_PP_STRINGIZE(elem) " is not fixed-size" );
+
+/**
+ * Like EOSLIB_SERIALIZE, but packs and unpacks the record with one
+ * bounds-checked copy instead of field by field. MEMBERS must list every
+ * field in declaration order; the static_asserts reject records with
+ * padding, variable-length fields or non-trivial copies.
+ */
+#define EOSLIB_SERIALIZE_FIXED( TYPE, MEMBERS ) \
+   typedef TYPE fixed_layout_record; \
+   template<typename DataStream> \
+   friend DataStream& operator << ( DataStream& ds, const TYPE& t ) { \
+      BOOST_PP_SEQ_FOR_EACH( EOSLIB_FIXED_MEMBER_CHECK, TYPE, MEMBERS ) \
+      static_assert( std::is_trivially_copyable<TYPE>::value, #TYPE " is not trivially copyable" ); \
+      static_assert( sizeof(TYPE) == 0 BOOST_PP_SEQ_FOR_EACH( EOSLIB_FIXED_MEMBER_SIZE, TYPE, MEMBERS ), #TYPE " has padding or unlisted fields" ); \
+      ds.write( (const char*)&t, sizeof(TYPE) ); \
+      return ds; \
+   } \
+   template<typename DataStream> \
+   friend DataStream& operator >> ( DataStream& ds, TYPE& t ) { \
+      ds.read( (char*)&t, sizeof(TYPE) ); \
+      return ds; \
+   }
@@ -0,0 +1,44 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+#include <eosiolib/multi_index.hpp>
+
+#include "checked_layout.hpp"
+#include "fixed_layout.hpp"
+#include "table_layouts.hpp"
+
+/**
+ * Friendships are owned by the friends contract and read by filespace to
+ * deliver posts to the author's friends. Both include this header.
+ */
+namespace inspace {
+
+   // @abi table friendships
+   struct friendship_rec { // 'friendship_record' is longer than 13 characters
+      uint64_t id;
+      account_name account1;
+      account_name account2;
+
+      auto primary_key() const { return id; }
+      account_name get_account1() const { return account1; }
+      account_name get_account2() const { return account2; }
+
+      EOSLIB_CHECK_LAYOUT(friendship_rec, friendship_layout, (id)(account1)(account2))
+      EOSLIB_SERIALIZE_FIXED(friendship_rec, (id)(account1)(account2))
+   };
+
+   typedef eosio::multi_index<N(friendships),
+                              friendship_rec,
+                              eosio::indexed_by<N(by_account1),
+                                                eosio::const_mem_fun<friendship_rec, account_name, &friendship_rec::get_account1>
+                                               >,
+                              eosio::indexed_by<N(by_account2),
+                                                eosio::const_mem_fun<friendship_rec, account_name, &friendship_rec::get_account2>
+                                               >
+                             > friendship_table_type;
+
+} /// namespace inspace
@@ -0,0 +1,67 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+#include <eosiolib/multi_index.hpp>
+
+#include "checked_layout.hpp"
+#include "fixed_layout.hpp"
+#include "projected_table.hpp"
+#include "table_layouts.hpp"
+
+#include <cstddef>
+
+/**
+ * The likes table is owned by the filespace contract and read by iscoin to
+ * distribute fees. Both include this header, so the record and the layout
+ * used for projected reads cannot drift apart.
+ */
+namespace inspace {
+
+   /** key of the likes of one version: the liked account in the high half, the version in the low half **/
+   inline uint128_t like_target(account_name liked, uint64_t version) {
+      return (uint128_t(liked) << 64) | version;
+   }
+
+   // @abi table likes
+   struct like_record {
+      uint64_t id;
+      account_name liker;
+      account_name liked;
+      uint64_t version;
+
+      auto primary_key() const { return id; }
+      uint128_t get_target() const { return like_target(liked, version); }
+
+      EOSLIB_CHECK_LAYOUT(like_record, like_export_layout, (id)(liker)(liked)(version))
+      EOSLIB_SERIALIZE_FIXED(like_record, (id)(liker)(liked)(version))
+   };
+
+   typedef eosio::multi_index<N(likes),
+                              like_record,
+                              eosio::indexed_by<N(by_target), /** secondary index on liked account and version **/
+                                                eosio::const_mem_fun<like_record, uint128_t, &like_record::get_target>
+                                               >
+                             > like_table_type;
+
+   /** packed layout of like_record, for reading single fields **/
+   typedef row_layout<uint64_t, account_name, account_name, uint64_t> like_layout;
+
+   enum like_field {
+      like_id,
+      like_liker,
+      like_liked,
+      like_version
+   };
+
+   static_assert(like_layout::offset<like_liker>() == offsetof(like_record, liker), "like_layout does not match like_record");
+   static_assert(like_layout::offset<like_liked>() == offsetof(like_record, liked), "like_layout does not match like_record");
+   static_assert(like_layout::offset<like_version>() == offsetof(like_record, version), "like_layout does not match like_record");
+   static_assert(like_layout::fixed_size == sizeof(like_record), "like_layout does not match like_record");
+
+   typedef projected_table<N(likes), like_layout> like_view;
+
+} /// namespace inspace
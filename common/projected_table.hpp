@@ -0,0 +1,101 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+#include <eosiolib/db.h>
+
+#include "row_layout.hpp"
+
+#include <vector>
+
+namespace inspace {
+
+   /**
+    * Read-only access to another contract's table that decodes single fields
+    * straight from the packed row instead of unpacking whole records. Fields
+    * at a fixed offset are read by copying only the bytes up to them; fields
+    * after a string load the row once and skip the strings in place.
+    */
+   template<uint64_t TableName, typename Layout>
+   class projected_table {
+      public:
+         class const_iterator {
+            public:
+               /** decodes field I of the current row **/
+               template<size_t I>
+               typename Layout::template value_type<I> get()const {
+                  typename Layout::template value_type<I> value;
+                  bool ok;
+                  if (Layout::template prefix_size<I>() != 0) {
+                     load_prefix(Layout::template prefix_size<I>());
+                     ok = Layout::template read<I>(prefix, prefix_loaded, value);
+                  } else {
+                     load_row();
+                     ok = Layout::template read<I>(row.data(), row.size(), value);
+                  }
+                  eosio_assert(ok, "row does not match its layout");
+                  return value;
+               }
+
+               const_iterator& operator++() {
+                  eosio_assert(itr >= 0, "cannot increment end iterator");
+                  uint64_t pk;
+                  itr = db_next_i64(itr, &pk);
+                  prefix_loaded = 0;
+                  row.clear();
+                  return *this;
+               }
+
+               bool operator==(const const_iterator& other)const {
+                  return (itr < 0 && other.itr < 0) || itr == other.itr;
+               }
+               bool operator!=(const const_iterator& other)const { return !(*this == other); }
+
+            private:
+               friend class projected_table;
+
+               explicit const_iterator(int itr) : itr(itr) {}
+
+               void load_prefix(size_t size)const {
+                  if (prefix_loaded >= size) {
+                     return;
+                  }
+                  const int row_size = db_get_i64(itr, prefix, size);
+                  prefix_loaded = size < (size_t)row_size ? size : (size_t)row_size;
+               }
+
+               void load_row()const {
+                  if (!row.empty()) {
+                     return;
+                  }
+                  const int row_size = db_get_i64(itr, nullptr, 0);
+                  row.resize(row_size);
+                  db_get_i64(itr, row.data(), row_size);
+               }
+
+               static_assert(Layout::fixed_size > 0, "layouts start with the fixed primary key");
+
+               int                 itr;
+               mutable char        prefix[Layout::fixed_size];
+               mutable size_t      prefix_loaded = 0;
+               mutable std::vector<char> row;
+         };
+
+         projected_table(account_name code, uint64_t scope) : code(code), scope(scope) {}
+
+         const_iterator begin()const { return lower_bound(0); }
+         const_iterator end()const { return const_iterator(-1); }
+
+         const_iterator lower_bound(uint64_t primary)const {
+            return const_iterator(db_lowerbound_i64(code, scope, TableName, primary));
+         }
+
+      private:
+         account_name code;
+         uint64_t scope;
+   };
+
+} /// namespace inspace
@@ -0,0 +1,176 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+/**
+ * Field-by-field descriptions of packed table rows. They only depend on the
+ * standard library, so both the contracts and native tools can decode rows
+ * from the same description.
+ */
+namespace inspace {
+
+   /** a string field, packed as a varuint32 length followed by the bytes **/
+   struct var_string {};
+
+   template<typename Field>
+   struct field_traits {
+      static_assert(std::is_trivially_copyable<Field>::value, "fixed fields must be trivially copyable");
+      typedef Field value_type;
+      static constexpr bool fixed = true;
+      static constexpr size_t size = sizeof(Field);
+   };
+
+   template<>
+   struct field_traits<var_string> {
+      typedef std::string value_type;
+      static constexpr bool fixed = false;
+      static constexpr size_t size = 0;
+   };
+
+   /** reads a varuint32 as packed by eosio::datastream. returns false if it runs past end. **/
+   inline bool read_varuint32(const char*& pos, const char* end, uint32_t& value) {
+      value = 0;
+      for (uint32_t shift = 0; pos < end && shift < 35; shift += 7) {
+         const uint8_t byte = (uint8_t)*pos++;
+         value |= uint32_t(byte & 0x7f) << shift;
+         if ((byte & 0x80) == 0) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   namespace layout_detail {
+
+      /** offset of field I, counting strings as empty **/
+      template<size_t I, typename... Fields> struct offset;
+
+      template<typename Field, typename... Rest>
+      struct offset<0, Field, Rest...> {
+         static constexpr size_t value = 0;
+      };
+
+      template<size_t I, typename Field, typename... Rest>
+      struct offset<I, Field, Rest...> {
+         static constexpr size_t value = field_traits<Field>::size + offset<I - 1, Rest...>::value;
+      };
+
+      /** number of leading fixed fields **/
+      template<typename... Fields> struct fixed_count;
+
+      template<>
+      struct fixed_count<> {
+         static constexpr size_t value = 0;
+      };
+
+      template<typename Field, typename... Rest>
+      struct fixed_count<Field, Rest...> {
+         static constexpr size_t value = field_traits<Field>::fixed ? 1 + fixed_count<Rest...>::value : 0;
+      };
+
+      /** bytes taken by the leading fixed fields **/
+      template<typename... Fields> struct fixed_size;
+
+      template<>
+      struct fixed_size<> {
+         static constexpr size_t value = 0;
+      };
+
+      template<typename Field, typename... Rest>
+      struct fixed_size<Field, Rest...> {
+         static constexpr size_t value = field_traits<Field>::fixed ? field_traits<Field>::size + fixed_size<Rest...>::value : 0;
+      };
+
+      /** advances pos past the first I fields **/
+      template<size_t I, typename Field, typename... Rest>
+      struct skip {
+         static bool apply(const char*& pos, const char* end) {
+            size_t size = field_traits<Field>::size;
+            if (!field_traits<Field>::fixed) {
+               uint32_t length;
+               if (!read_varuint32(pos, end, length)) {
+                  return false;
+               }
+               size = length;
+            }
+            if (size_t(end - pos) < size) {
+               return false;
+            }
+            pos += size;
+            return skip<I - 1, Rest...>::apply(pos, end);
+         }
+      };
+
+      template<typename Field, typename... Rest>
+      struct skip<0, Field, Rest...> {
+         static bool apply(const char*&, const char*) { return true; }
+      };
+
+      inline bool read_field(const char* pos, const char* end, var_string, std::string& value) {
+         uint32_t length;
+         if (!read_varuint32(pos, end, length) || size_t(end - pos) < length) {
+            return false;
+         }
+         value.assign(pos, length);
+         return true;
+      }
+
+      template<typename Field>
+      bool read_field(const char* pos, const char* end, Field, Field& value) {
+         if (size_t(end - pos) < sizeof(Field)) {
+            return false;
+         }
+         memcpy(&value, pos, sizeof(Field));
+         return true;
+      }
+   }
+
+   /**
+    * The packed layout of a row, as a list of field types in serialization
+    * order. Fixed fields are any trivially copyable type packed as its raw
+    * bytes; strings are var_string.
+    */
+   template<typename... Fields>
+   struct row_layout {
+      static constexpr size_t field_count = sizeof...(Fields);
+
+      template<size_t I>
+      using field = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+
+      template<size_t I>
+      using value_type = typename field_traits<field<I>>::value_type;
+
+      /** the first fixed_count fields sit at fixed offsets **/
+      static constexpr size_t fixed_count = layout_detail::fixed_count<Fields...>::value;
+      static constexpr size_t fixed_size = layout_detail::fixed_size<Fields...>::value;
+
+      /** byte offset of field I. only meaningful when every field before it is fixed. **/
+      template<size_t I>
+      static constexpr size_t offset() { return layout_detail::offset<I, Fields...>::value; }
+
+      /** bytes needed to read field I without touching the rest of the row, or 0 if it follows a string **/
+      template<size_t I>
+      static constexpr size_t prefix_size() { return I < fixed_count ? offset<I>() + field_traits<field<I>>::size : 0; }
+
+      /** decodes field I from a packed row, skipping over the fields before it **/
+      template<size_t I>
+      static bool read(const char* data, size_t size, value_type<I>& value) {
+         const char* pos = data;
+         const char* end = data + size;
+         if (!layout_detail::skip<I, Fields...>::apply(pos, end)) {
+            return false;
+         }
+         return layout_detail::read_field(pos, end, field<I>(), value);
+      }
+   };
+
+} /// namespace inspace
@@ -0,0 +1,93 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include "row_layout.hpp"
+
+#include <cstdint>
+
+/**
+ * Packed layouts of every contract table, in EOSLIB_SERIALIZE order. They
+ * only depend on the standard library, so native tools under tools/ can
+ * decode table dumps without eosiolib. The contracts check their records
+ * against them field by field at compile time, with EOSLIB_SERIALIZE_LAYOUT
+ * or EOSLIB_CHECK_LAYOUT from checked_layout.hpp.
+ */
+namespace inspace {
+
+   /** an account name. packed like a uint64_t; the type tells tools it is a name. **/
+   struct name_field {
+      uint64_t value;
+   };
+
+   /** an eosio::asset **/
+   struct asset_field {
+      int64_t amount;
+      uint64_t symbol;
+   };
+
+   /** an eosio::time_point_sec **/
+   struct time_field {
+      uint32_t seconds;
+   };
+
+   /** an eosio::checksum256 **/
+   struct checksum_field {
+      uint8_t hash[32];
+   };
+
+   /** a string holding a hash, e.g. an IPFS hash or a hex sha256. packed like var_string. **/
+   struct hash_string {};
+
+   template<>
+   struct field_traits<hash_string> : field_traits<var_string> {};
+
+   /** filespace **/
+   typedef row_layout<uint64_t, var_string, uint64_t> folder_layout;
+   typedef row_layout<uint64_t, var_string, uint64_t, uint64_t> file_layout;
+   typedef row_layout<uint64_t, hash_string, hash_string, uint64_t, uint64_t, uint64_t> version_layout;
+   typedef row_layout<uint64_t, hash_string, uint64_t> profile_layout;
+   typedef row_layout<uint64_t, var_string, uint64_t> key_layout;
+   typedef row_layout<uint64_t, uint64_t, var_string, var_string, var_string, var_string> enc_key_layout;
+   typedef row_layout<uint64_t, name_field, bool, uint64_t, var_string, uint64_t> post_layout;
+   typedef row_layout<uint64_t, uint64_t, name_field, uint64_t> inbox_layout;
+   typedef row_layout<name_field> pull_author_layout;
+   typedef row_layout<uint64_t, checksum_field> folder_hash_layout;
+   typedef row_layout<checksum_field> root_hash_layout;
+   typedef row_layout<uint64_t, uint64_t, name_field, uint8_t> grant_layout;
+   typedef row_layout<uint64_t, name_field, uint64_t, uint8_t> share_layout;
+   typedef row_layout<uint64_t, uint8_t, uint64_t> acl_summary_layout;
+   typedef row_layout<uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t> usage_layout;
+   typedef row_layout<uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t> usage_recount_layout;
+   typedef row_layout<uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, bool> config_layout;
+   typedef row_layout<uint64_t, name_field, uint64_t> like_purge_layout;
+   typedef row_layout<uint64_t> like_audit_layout;
+   typedef row_layout<uint64_t, uint64_t> like_reindex_layout;
+   typedef row_layout<uint64_t, uint64_t, uint8_t, uint64_t> name_token_layout;
+   typedef row_layout<uint64_t, uint64_t, uint64_t, uint64_t> clone_job_layout;
+   typedef row_layout<uint64_t, uint64_t, uint64_t, uint64_t, uint8_t> clone_queue_layout;
+   typedef row_layout<uint64_t, uint64_t> version_ref_layout;
+   typedef row_layout<uint64_t, uint64_t> shared_version_layout;
+   typedef row_layout<uint64_t, uint64_t> key_migration_layout;
+   typedef row_layout<uint64_t, uint64_t> name_reindex_layout;
+   typedef row_layout<uint64_t, uint64_t> post_reindex_layout;
+
+   /** likes, as exported. like_layout in likes.hpp reads the same rows. **/
+   typedef row_layout<uint64_t, name_field, name_field, uint64_t> like_export_layout;
+
+   /** friends **/
+   typedef row_layout<uint64_t, name_field, name_field, uint64_t> request_layout;
+   typedef row_layout<name_field, uint64_t> request_count_layout;
+   typedef row_layout<uint64_t, uint64_t> request_reindex_layout;
+   typedef row_layout<uint64_t, name_field, name_field> friendship_layout;
+
+   /** iscoin **/
+   typedef row_layout<asset_field> account_layout;
+   typedef row_layout<asset_field, asset_field, name_field> currency_stats_layout;
+   typedef row_layout<uint64_t, asset_field, time_field, uint32_t> stake_layout;
+   typedef row_layout<name_field, asset_field, int64_t> stake_stat_layout;
+   typedef row_layout<asset_field, int64_t> stake_totals_layout;
+
+} /// namespace inspace
@@ -1,11 +1,82 @@
 #include <eosiolib/eosio.hpp>
 #include <eosiolib/print.hpp>
+#include <eosiolib/crypto.h>
+#include <eosiolib/singleton.hpp>
+#include <eosiolib/transaction.hpp>
+
+#include "../common/checked_layout.hpp"
+#include "../common/fixed_layout.hpp"
+#include "../common/likes.hpp"
+#include "../common/friendship.hpp"
+#include "../common/table_layouts.hpp"
+
+#include <algorithm>
 
 using namespace eosio;
 using namespace std;
 
 static const uint64_t NULL_ID = 0;
 
+/** bounds walks along the ancestor chain of a folder **/
+static const uint32_t MAX_FOLDER_DEPTH = 64;
+
+/** rights a grant can give on a folder and everything below it **/
+static const uint8_t ACL_WRITE = 1;  /** add folders, files and versions **/
+static const uint8_t ACL_DELETE = 2; /** delete files **/
+static const uint8_t ACL_ALL = ACL_WRITE | ACL_DELETE;
+
+/** the friends contract, whose friendships decide whose inbox a post goes to **/
+static const account_name FRIENDS_ACCOUNT = N(friends);
+
+/** entries kept in an inbox. the oldest are trimmed as new posts arrive. **/
+static const uint64_t MAX_INBOX_LENGTH = 500;
+
+/** inbox entries trimmed per delivery, so one post never pays for a long backlog **/
+static const uint32_t INBOX_TRIM_BATCH = 4;
+
+/** authors with more friends than this are read from the posts table instead of copied into inboxes **/
+static const uint32_t MAX_FANOUT = 100;
+
+/** likes erased per action when versions are deleted. the rest are queued for purgelikes. **/
+static const uint32_t LIKE_PURGE_BATCH = 50;
+
+/** what a nameindex entry points to **/
+static const uint8_t NAME_FOLDER = 1;
+static const uint8_t NAME_FILE = 2;
+
+/** tokens indexed per name, so long names can't make an action arbitrarily expensive **/
+static const uint32_t MAX_NAME_TOKENS = 16;
+
+/** folders and files copied by clonefolder itself. clonestep copies the rest. **/
+static const uint32_t CLONE_BATCH = 50;
+
+/** phases of a clonequeue entry **/
+static const uint8_t CLONE_PHASE_FOLDERS = 0;
+static const uint8_t CLONE_PHASE_FILES = 1;
+
+/** version_count of keys written before versions were counted, until migratekeys counts them **/
+static const uint64_t UNCOUNTED = uint64_t(-1);
+
+/** phases of reindexnames **/
+static const uint64_t NAME_REINDEX_FOLDERS = 0;
+static const uint64_t NAME_REINDEX_FILES = 1;
+static const uint64_t NAME_REINDEX_DONE = 2;
+
+/** phases of recountusage **/
+static const uint64_t RECOUNT_FOLDERS = 0;
+static const uint64_t RECOUNT_FILES = 1;
+static const uint64_t RECOUNT_VERSIONS = 2;
+static const uint64_t RECOUNT_KEYS = 3;
+static const uint64_t RECOUNT_ENC_KEYS = 4;
+static const uint64_t RECOUNT_NAMES = 5;
+static const uint64_t RECOUNT_DONE = 6;
+
+/** phases of migratekeys **/
+static const uint64_t MIGRATE_VERSIONS = 0;
+static const uint64_t MIGRATE_KEYS = 1;
+static const uint64_t MIGRATE_ENC_KEYS = 2;
+static const uint64_t MIGRATE_DONE = 3;
+
 class filespace : public contract {
    using contract::contract;
 
@@ -14,35 +85,20 @@ class filespace : public contract {
       filespace(account_name self) : contract(self) {}
 
       // @abi action
-      void addfolder(account_name user, uint64_t id, string name, uint64_t parent_folder) {
+      void addfolder(account_name user, uint64_t id, const string& name, uint64_t parent_folder) {
          require_auth(user);
+         add_folder(user, id, name, parent_folder);
+      }
 
-         /** user's scope **/
-         folder_table_type folder_table(_self, user);
-
-         /** check whether the id exists **/
-         auto iterator = folder_table.find(id);
-         eosio_assert(iterator == folder_table.end(), "Folder id exists!");
-
-         /** check whether parent exists **/
-         if (parent_folder != NULL_ID) {
-            iterator = folder_table.find(parent_folder);
-            eosio_assert(iterator != folder_table.end(), "Parent folder does not exist!");
-         }
-
-         /** make sure the name is valid **/
-         eosio_assert(!name_exists(user, name, parent_folder), "Name exists!");
-
-         /** add the record **/
-         folder_table.emplace(_self, [&](auto& folder_record) {
-            folder_record.id = id;
-            folder_record.name = name;
-            folder_record.parent_folder = parent_folder;
-         });
+      /** adds a folder to another user's space. needs write access to the parent folder. **/
+      // @abi action
+      void addfolderas(account_name grantee, account_name owner, uint64_t id, const string& name, uint64_t parent_folder) {
+         require_grant(grantee, owner, parent_folder, ACL_WRITE);
+         add_folder(owner, id, name, parent_folder);
       }
 
       // @abi action
-      void renamefolder(account_name user, uint64_t id, string new_name) {
+      void renamefolder(account_name user, uint64_t id, const string& new_name) {
          require_auth(user);
 
          folder_table_type folder_table(_self, user);
@@ -55,9 +111,15 @@ class filespace : public contract {
          eosio_assert(!name_exists(user, new_name, (*iterator).parent_folder), "Name exists!");
 
          /** modify the record **/
-         folder_table.modify(iterator, _self, [&](auto& folder_record) {
+         const int64_t old_size = pack_size(*iterator);
+         folder_table.modify(iterator, ram_payer(user), [&](auto& folder_record) {
             folder_record.name = new_name;
          });
+         add_usage(user, usage_folders, 0, int64_t(pack_size(*iterator)) - old_size);
+         index_name(user, NAME_FOLDER, id, new_name);
+
+         update_hashes(user, (*iterator).parent_folder);
+         save_usage();
       }
 
       // @abi action
@@ -79,46 +141,32 @@ class filespace : public contract {
          /** make sure the name is valid **/
          eosio_assert(!name_exists(user, (*iterator).name, new_parent_folder), "Name exists!");
 
+         const uint64_t old_parent_folder = (*iterator).parent_folder;
+
          /** modify the record **/
-         folder_table.modify(iterator, _self, [&](auto& folder_record) {
+         folder_table.modify(iterator, ram_payer(user), [&](auto& folder_record) {
             folder_record.parent_folder = new_parent_folder;
          });
+
+         update_hashes(user, old_parent_folder);
+         update_hashes(user, new_parent_folder);
       }
 
       // @abi action
-      void addfile(account_name user, uint64_t id, string name, uint64_t parent_folder, uint64_t current_version) {
+      void addfile(account_name user, uint64_t id, const string& name, uint64_t parent_folder, uint64_t current_version) {
          require_auth(user);
+         add_file(user, id, name, parent_folder, current_version);
+      }
 
-         file_table_type file_table(_self, user);
-         folder_table_type folder_table(_self, user);
-
-         /** check whether the id exists **/
-         auto iterator = file_table.find(id);
-         eosio_assert(iterator == file_table.end(), "File id exists!");
-
-         /** check whether parent exists **/
-         if (parent_folder != NULL_ID) {
-         auto iterator = folder_table.find(parent_folder);
-            eosio_assert(iterator != folder_table.end(), "Parent folder does not exist!");
-         }
-
-         /** make sure the version is valid **/
-         eosio_assert(version_valid(user, current_version, id), "Version is not valid!");
-
-         /** make sure the name is valid **/
-         eosio_assert(!name_exists(user, name, parent_folder), "Name exists!");
-
-         /** add the record **/
-         file_table.emplace(_self, [&](auto& file_record) {
-            file_record.id = id;
-            file_record.name = name;
-            file_record.parent_folder = parent_folder;
-            file_record.current_version = current_version;
-         });
+      /** adds a file to another user's space. needs write access to the parent folder. **/
+      // @abi action
+      void addfileas(account_name grantee, account_name owner, uint64_t id, const string& name, uint64_t parent_folder, uint64_t current_version) {
+         require_grant(grantee, owner, parent_folder, ACL_WRITE);
+         add_file(owner, id, name, parent_folder, current_version);
       }
 
       // @abi action
-      void renamefile(account_name user, uint64_t id, string new_name) {
+      void renamefile(account_name user, uint64_t id, const string& new_name) {
          require_auth(user);
 
          file_table_type file_table(_self, user);
@@ -131,9 +179,15 @@ class filespace : public contract {
          eosio_assert(!name_exists(user, new_name, (*iterator).parent_folder), "Name exists!");
 
          /** modify the record **/
-         file_table.modify(iterator, _self, [&](auto& file_record) {
+         const int64_t old_size = pack_size(*iterator);
+         file_table.modify(iterator, ram_payer(user), [&](auto& file_record) {
             file_record.name = new_name;
          });
+         add_usage(user, usage_files, 0, int64_t(pack_size(*iterator)) - old_size);
+         index_name(user, NAME_FILE, id, new_name);
+
+         update_hashes(user, (*iterator).parent_folder);
+         save_usage();
       }
 
       // @abi action
@@ -156,10 +210,15 @@ class filespace : public contract {
          /** make sure the name is valid **/
          eosio_assert(!name_exists(user, (*iterator).name, new_parent_folder), "Name exists!");
 
+         const uint64_t old_parent_folder = (*iterator).parent_folder;
+
          /** modify the record **/
-         file_table.modify(iterator, _self, [&](auto& file_record) {
+         file_table.modify(iterator, ram_payer(user), [&](auto& file_record) {
             file_record.parent_folder = new_parent_folder;
          });
+
+         update_hashes(user, old_parent_folder);
+         update_hashes(user, new_parent_folder);
       }
 
       /** would be 'setcurrentversion' without the length limit **/
@@ -177,44 +236,275 @@ class filespace : public contract {
          eosio_assert(version_valid(user, new_current_version, id), "Version is not valid!");
 
          /** modify the record **/
-         file_table.modify(iterator, _self, [&](auto& file_record) {
+         file_table.modify(iterator, ram_payer(user), [&](auto& file_record) {
             file_record.current_version = new_current_version;
          });
+
+         update_hashes(user, (*iterator).parent_folder);
+      }
+
+      // @abi action
+      void addversion(account_name user, uint64_t id, const string& ipfs_hash, const string& sha256, uint64_t date, uint64_t file, uint64_t key) {
+         require_auth(user);
+         add_version(user, id, ipfs_hash, sha256, date, file, key);
+      }
+
+      /** adds a version of a file in another user's space. needs write access to the file's folder. **/
+      // @abi action
+      void addversionas(account_name grantee, account_name owner, uint64_t id, const string& ipfs_hash, const string& sha256, uint64_t date, uint64_t file, uint64_t key) {
+         require_grant(grantee, owner, file_parent(owner, file), ACL_WRITE);
+         add_version(owner, id, ipfs_hash, sha256, date, file, key);
+      }
+
+      /** moves up to max_count versions from one key to another, for key rotation. repeat until from_key is unused. **/
+      // @abi action
+      void rekeyvers(account_name user, uint64_t from_key, uint64_t to_key, uint32_t max_count) {
+         require_auth(user);
+
+         version_table_type version_table(_self, user);
+         key_table_type key_table(_self, user);
+
+         eosio_assert(from_key != to_key, "Keys are the same!");
+
+         /** check whether the keys exist **/
+         auto from_iterator = key_table.find(from_key);
+         eosio_assert(from_iterator != key_table.end(), "Key does not exist!");
+         auto to_iterator = key_table.find(to_key);
+         eosio_assert(to_iterator != key_table.end(), "Key does not exist!");
+
+         /** each modify moves the version out of from_key's range, so look up the next one afresh **/
+         auto versions_by_key = version_table.get_index<N(by_key)>();
+         uint32_t count = 0;
+         for (auto iterator = versions_by_key.find(from_key); count < max_count && iterator != versions_by_key.end(); iterator = versions_by_key.find(from_key)) {
+            versions_by_key.modify(iterator, ram_payer(user), [&](auto& version_record) {
+               version_record.key = to_key;
+            });
+            ++count;
+         }
+
+         if (count == 0) {
+            return;
+         }
+
+         key_table.modify(from_iterator, ram_payer(user), [&](auto& key_record) {
+            key_record.add_versions(-int64_t(count));
+         });
+         key_table.modify(to_iterator, ram_payer(user), [&](auto& key_record) {
+            key_record.add_versions(count);
+         });
       }
 
+      /** a node of an imported tree. nodes are sent in pre-order. **/
+      struct import_node {
+         uint64_t id;
+         uint32_t parent; /** distance back to the parent node in the same import, or 0 for the base folder **/
+         bool is_folder;
+         string name;
+
+         /** files only: the current version. no version is added if it is NULL_ID. **/
+         uint64_t version;
+         string ipfs_hash;
+         string sha256;
+         uint64_t date;
+         uint64_t key;
+
+         EOSLIB_SERIALIZE(import_node, (id)(parent)(is_folder)(name)(version)(ipfs_hash)(sha256)(date)(key))
+      };
+
+      /** adds a whole tree below base_folder. large trees can be split into several imports, each below a folder added by an earlier one. **/
       // @abi action
-      void addversion(account_name user, uint64_t id, string ipfs_hash, string sha256, uint64_t date, uint64_t file, uint64_t key) {
+      void importtree(account_name user, uint64_t base_folder, const vector<import_node>& nodes) {
          require_auth(user);
 
+         folder_table_type folder_table(_self, user);
          file_table_type file_table(_self, user);
          version_table_type version_table(_self, user);
          key_table_type key_table(_self, user);
 
-         /** check whether the id exists **/
-         auto iterator = version_table.find(id);
-         eosio_assert(iterator == version_table.end(), "Version id exists!");
+         /** check whether the base folder exists **/
+         if (base_folder != NULL_ID) {
+            auto iterator = folder_table.find(base_folder);
+            eosio_assert(iterator != folder_table.end(), "Parent folder does not exist!");
+         }
 
-         /** check whether file exists **/
-         if (file != NULL_ID) {
-           auto iterator = file_table.find(file);
-           eosio_assert(iterator != file_table.end(), "File does not exist!");
+         /** resolve parents within the import, without table lookups **/
+         vector<uint64_t> parents(nodes.size());
+         for (size_t i = 0; i < nodes.size(); ++i) {
+            const uint32_t parent = nodes[i].parent;
+            if (parent == 0) {
+               parents[i] = base_folder;
+               continue;
+            }
+            eosio_assert(parent <= i, "Parent is not before the node!");
+            eosio_assert(nodes[i - parent].is_folder, "Parent is not a folder!");
+            parents[i] = nodes[i - parent].id;
          }
 
-         /** check whether key exists **/
-         if (key != NULL_ID) {
-           auto iterator = key_table.find(key);
-           eosio_assert(iterator != key_table.end(), "Key does not exist!");
+         /** make sure the names are valid, including against what the base folder already holds **/
+         eosio_assert(!import_names_clash(user, base_folder, nodes, parents), "Name exists!");
+
+         /** add the records in one pass. duplicate ids are rejected by the database. **/
+         vector<key_count> key_counts;
+         for (size_t i = 0; i < nodes.size(); ++i) {
+            const import_node& node = nodes[i];
+
+            if (node.is_folder) {
+               auto added = folder_table.emplace(ram_payer(user), [&](auto& folder_record) {
+                  folder_record.id = node.id;
+                  folder_record.name = node.name;
+                  folder_record.parent_folder = parents[i];
+               });
+               add_usage(user, usage_folders, 1, pack_size(*added));
+               index_name(user, NAME_FOLDER, node.id, node.name);
+               continue;
+            }
+
+            if (node.version != NULL_ID) {
+               /** keys are checked and counted once per distinct key, after the loop **/
+               if (node.key != NULL_ID) {
+                  count_key(key_counts, node.key);
+               }
+
+               auto added = version_table.emplace(ram_payer(user), [&](auto& version_record) {
+                  version_record.id = node.version;
+                  version_record.ipfs_hash = node.ipfs_hash;
+                  version_record.sha256 = node.sha256;
+                  version_record.date = node.date;
+                  version_record.file = node.id;
+                  version_record.key = node.key;
+               });
+               add_usage(user, usage_versions, 1, pack_size(*added));
+            }
+
+            auto added = file_table.emplace(ram_payer(user), [&](auto& file_record) {
+               file_record.id = node.id;
+               file_record.name = node.name;
+               file_record.parent_folder = parents[i];
+               file_record.current_version = node.version;
+            });
+            add_usage(user, usage_files, 1, pack_size(*added));
+            index_name(user, NAME_FILE, node.id, node.name);
          }
 
-         /** add the record **/
-         version_table.emplace(_self, [&](auto& version_record) {
-             version_record.id = id;
-             version_record.ipfs_hash = ipfs_hash;
-             version_record.sha256 = sha256;
-             version_record.date = date;
-             version_record.file = file;
-             version_record.key = key;
+         /** check whether the keys exist, and count the versions against them **/
+         for (const key_count& counted : key_counts) {
+            auto iterator = key_table.find(counted.key);
+            eosio_assert(iterator != key_table.end(), "Key does not exist!");
+            key_table.modify(iterator, ram_payer(user), [&](auto& key_record) {
+               key_record.add_versions(counted.count);
+            });
+         }
+
+         /** hash the new folders bottom-up, then update the base folder and its ancestors **/
+         folder_hash_table_type folder_hash_table(_self, user);
+         for (size_t i = nodes.size(); i-- > 0; ) {
+            if (!nodes[i].is_folder) {
+               continue;
+            }
+            const checksum256 hash = folder_hash(user, nodes[i].id);
+            folder_hash_table.emplace(ram_payer(user), [&](auto& folder_hash_record) {
+               folder_hash_record.id = nodes[i].id;
+               folder_hash_record.hash = hash;
+            });
+         }
+
+         update_hashes(user, base_folder);
+         save_usage();
+      }
+
+      /**
+       * copies the folder source_folder and everything below it into new_parent_folder, as id
+       * with new_name. the copies of the folders and files below get their source's id plus
+       * id_offset. copied files share their current version with the source instead of copying
+       * it; either copy diverges when it gets a new version. the first CLONE_BATCH folders and
+       * files are copied here, the rest by calling clonestep until the clonejob is gone.
+       */
+      // @abi action
+      void clonefolder(account_name user, uint64_t id, uint64_t source_folder, uint64_t new_parent_folder, const string& new_name, uint64_t id_offset) {
+         require_auth(user);
+
+         folder_table_type folder_table(_self, user);
+         clone_job_singleton_type clone_job(_self, user);
+
+         eosio_assert(!clone_job.exists(), "Clone in progress!");
+         eosio_assert(id_offset != 0, "Id offset must not be zero!");
+
+         /** check whether the source exists **/
+         eosio_assert(folder_table.find(source_folder) != folder_table.end(), "Folder id does not exist!");
+
+         /** check whether the new parent exists, and is not inside what is being copied **/
+         uint64_t ancestor = new_parent_folder;
+         for (uint32_t depth = 0; ancestor != NULL_ID; ++depth) {
+            eosio_assert(depth <= MAX_FOLDER_DEPTH, "Folder tree is too deep!");
+            eosio_assert(ancestor != source_folder, "Can't clone a folder into itself!");
+            auto iterator = folder_table.find(ancestor);
+            eosio_assert(iterator != folder_table.end(), "Parent folder does not exist!");
+            ancestor = (*iterator).parent_folder;
+         }
+
+         eosio_assert(folder_table.find(id) == folder_table.end(), "Folder id exists!");
+         eosio_assert(!name_exists(user, new_name, new_parent_folder), "Name exists!");
+
+         /** the copy gets its hash as its parts are copied **/
+         auto added = folder_table.emplace(ram_payer(user), [&](auto& folder_record) {
+            folder_record.id = id;
+            folder_record.name = new_name;
+            folder_record.parent_folder = new_parent_folder;
          });
+         add_usage(user, usage_folders, 1, pack_size(*added));
+         index_name(user, NAME_FOLDER, id, new_name);
+         update_hashes(user, new_parent_folder);
+
+         clone_job.set(clone_job_record{source_folder, id, id_offset, 0}, ram_payer(user));
+
+         clone_queue_table_type clone_queue_table(_self, user);
+         clone_queue_table.emplace(ram_payer(user), [&](auto& clone_queue_record) {
+            clone_queue_record.id = clone_queue_table.available_primary_key();
+            clone_queue_record.source = source_folder;
+            clone_queue_record.target = id;
+            clone_queue_record.last_child = NULL_ID;
+            clone_queue_record.phase = CLONE_PHASE_FOLDERS;
+         });
+
+         clone_step(user, CLONE_BATCH);
+         save_usage();
+      }
+
+      /** copies up to max_count more folders and files of the clone in progress **/
+      // @abi action
+      void clonestep(account_name user, uint32_t max_count) {
+         require_auth(user);
+
+         eosio_assert(clone_job_singleton_type(_self, user).exists(), "No clone in progress!");
+
+         clone_step(user, max_count);
+         save_usage();
+      }
+
+      /**
+       * drops up to max_count pending parts of the clone in progress. what was copied stays, and
+       * the hashes of folders left partly copied are made to match it.
+       */
+      // @abi action
+      void cancelclone(account_name user, uint32_t max_count) {
+         require_auth(user);
+
+         clone_job_singleton_type clone_job(_self, user);
+         eosio_assert(clone_job.exists(), "No clone in progress!");
+
+         clone_queue_table_type clone_queue_table(_self, user);
+         auto iterator = clone_queue_table.begin();
+         folder_table_type folder_table(_self, user);
+         for (uint32_t count = 0; count < max_count && iterator != clone_queue_table.end(); ++count) {
+            if (folder_table.find((*iterator).target) != folder_table.end()) {
+               update_hashes(user, (*iterator).target);
+            }
+            iterator = clone_queue_table.erase(iterator);
+         }
+
+         if (iterator == clone_queue_table.end()) {
+            clone_job.remove();
+         }
       }
 
       // @abi action
@@ -233,7 +523,7 @@ class filespace : public contract {
          eosio_assert(version_iterator != version_table.end(), "Version does not exist!");
 
          /** add the record **/
-         like_table.emplace(_self, [&](auto& like_record) {
+         like_table.emplace(ram_payer(user), [&](auto& like_record) {
              like_record.id = id;
              like_record.liker = user;
              like_record.liked = liked;
@@ -262,30 +552,38 @@ class filespace : public contract {
          auto file_iterator = files_by_parent.find(id);
          eosio_assert(file_iterator == files_by_parent.end(), "Folder is not empty!");
 
-         /** delete the folder **/
+         /** grants would outlive the folder **/
+         acl_summary_table_type acl_summary_table(_self, user);
+         eosio_assert(acl_summary_table.find(id) == acl_summary_table.end(), "Folder is shared!");
+
+         const uint64_t parent_folder = (*iterator).parent_folder;
+
+         /** delete the folder and its hash **/
+         add_usage(user, usage_folders, -1, -int64_t(pack_size(*iterator)));
          folder_table.erase(iterator);
+         unindex_name(user, NAME_FOLDER, id);
+
+         folder_hash_table_type folder_hash_table(_self, user);
+         auto hash_iterator = folder_hash_table.find(id);
+         if (hash_iterator != folder_hash_table.end()) {
+            folder_hash_table.erase(hash_iterator);
+         }
+
+         update_hashes(user, parent_folder);
+         save_usage();
       }
 
       // @abi action
       void deletefile(account_name user, uint64_t id) {
          require_auth(user);
+         delete_file(user, id);
+      }
 
-         file_table_type file_table(_self, user);
-         version_table_type version_table(_self, user);
-
-         /** get the file and make sure it exists **/
-         auto iterator = file_table.find(id);
-         eosio_assert(iterator != file_table.end(), "File id does not exist!");
-
-         /** delete all versions **/
-         auto versions_by_file = version_table.get_index<N(by_file)>();
-         auto version_iterator = versions_by_file.find(id);
-         while (version_iterator != versions_by_file.end()) {
-            version_iterator = versions_by_file.erase(version_iterator);
-         }
-
-         /** delete the file itself **/
-         file_table.erase(iterator);
+      /** deletes a file in another user's space. needs delete access to the file's folder. **/
+      // @abi action
+      void deletefileas(account_name grantee, account_name owner, uint64_t id) {
+         require_grant(grantee, owner, file_parent(owner, id), ACL_DELETE);
+         delete_file(owner, id);
       }
 
       // @abi action
@@ -305,8 +603,87 @@ class filespace : public contract {
          like_table.erase(iterator);
       }
 
+      /** erases up to max_count queued likes of deleted versions, and schedules another run if some are left **/
+      // @abi action
+      void purgelikes(uint32_t max_count) {
+         require_auth(_self);
+
+         like_table_type like_table(_self, _self);
+         auto likes_by_target = like_table.get_index<N(by_target)>();
+         like_purge_table_type like_purge_table(_self, _self);
+
+         uint32_t budget = max_count;
+         auto iterator = like_purge_table.begin();
+         while (iterator != like_purge_table.end() && erase_likes(likes_by_target, (*iterator).liked, (*iterator).version, budget)) {
+            iterator = like_purge_table.erase(iterator);
+         }
+
+         if (iterator != like_purge_table.end()) {
+            schedule_like_purge();
+         }
+      }
+
+      /**
+       * checks up to max_count likes, starting where the last call stopped, and erases those
+       * whose version no longer exists. for likes left behind before deletes purged them.
+       */
+      // @abi action
+      void auditlikes(uint32_t max_count) {
+         require_auth(_self);
+
+         like_table_type like_table(_self, _self);
+         like_audit_singleton_type like_audit(_self, _self);
+         like_audit_record cursor = like_audit.get_or_default(like_audit_record{});
+
+         auto iterator = like_table.lower_bound(cursor.next_id);
+         for (uint32_t count = 0; count < max_count && iterator != like_table.end(); ++count) {
+            version_table_type version_table(_self, (*iterator).liked);
+            if (version_table.find((*iterator).version) == version_table.end()) {
+               iterator = like_table.erase(iterator);
+            } else {
+               ++iterator;
+            }
+         }
+
+         /** start over once the end is reached **/
+         cursor.next_id = iterator == like_table.end() ? 0 : (*iterator).id;
+         like_audit.set(cursor, _self);
+      }
+
+      /**
+       * adds back up to max_count likes, each billed as addlike bills it, which gives likes
+       * written before the by_target index their missing entry. likes of versions that no
+       * longer exist are erased instead. repeat until it asserts that the likes are reindexed.
+       * when users pay for RAM it also needs the likers' authority.
+       */
+      // @abi action
+      void reindexlikes(uint32_t max_count) {
+         require_auth(_self);
+
+         like_reindex_singleton_type like_reindex(_self, _self);
+         like_reindex_record state = like_reindex.get_or_default(like_reindex_record{});
+         eosio_assert(!state.done, "Likes are reindexed!");
+
+         like_table_type like_table(_self, _self);
+         auto iterator = like_table.lower_bound(state.next_id);
+         for (uint32_t count = 0; count < max_count && iterator != like_table.end(); ++count) {
+            const like_record like = *iterator;
+            iterator = like_table.erase(iterator);
+            version_table_type version_table(_self, like.liked);
+            if (version_table.find(like.version) != version_table.end()) {
+               like_table.emplace(ram_payer(like.liker), [&](auto& like_record) {
+                  like_record = like;
+               });
+            }
+            state.next_id = like.id + 1;
+         }
+
+         state.done = iterator == like_table.end();
+         like_reindex.set(state, _self);
+      }
+
       // @abi action
-      void setprofile(account_name user, string ipfs_hash, uint64_t key) {
+      void setprofile(account_name user, const string& ipfs_hash, uint64_t key) {
          require_auth(user);
 
          profile_table_type profile_table(_self, user);
@@ -322,14 +699,14 @@ class filespace : public contract {
          auto iterator = profile_table.find(0);
          if (iterator == profile_table.end()) {
             /** profile does not exist. add one. **/
-            profile_table.emplace(_self, [&](auto& profile_record) {
+            profile_table.emplace(ram_payer(user), [&](auto& profile_record) {
                profile_record.id = 0;
                profile_record.ipfs_hash = ipfs_hash;
                profile_record.key = key;
             });
          } else {
             /** does exist. modify the record **/
-            profile_table.modify(iterator, _self, [&](auto& profile_record) {
+            profile_table.modify(iterator, ram_payer(user), [&](auto& profile_record) {
                profile_record.ipfs_hash = ipfs_hash;
                profile_record.key = key;
             });
@@ -337,7 +714,7 @@ class filespace : public contract {
       }
 
       // @abi action
-      void addkey(account_name user, uint64_t id, string iv) {
+      void addkey(account_name user, uint64_t id, const string& iv) {
          key_table_type key_table(_self, user);
 
          require_auth(user);
@@ -347,116 +724,1393 @@ class filespace : public contract {
          eosio_assert(key_iterator == key_table.end(), "Key id exists!");
 
          /** add the record **/
-         key_table.emplace(_self, [&](auto& key_record) {
+         auto added = key_table.emplace(ram_payer(user), [&](auto& key_record) {
              key_record.id = id;
              key_record.iv = iv;
+             key_record.version_count = 0;
          });
+         add_usage(user, usage_keys, 1, pack_size(*added));
+
+         save_usage();
       }
 
+      /** deletes a key that no version, profile or encrypted copy uses any more **/
       // @abi action
-      void addenckey(account_name user, uint64_t id, uint64_t key, string public_key, string iv, string nonce, string value) {
-         enc_key_table_type enc_key_table(_self, user);
+      void deletekey(account_name user, uint64_t id) {
          key_table_type key_table(_self, user);
 
          require_auth(user);
 
-         /** check whether the id exists **/
-         auto enc_key_iterator = enc_key_table.find(id);
-         eosio_assert(enc_key_iterator == enc_key_table.end(), "Enc key id exists!");
+         /** get the key and make sure it exists **/
+         auto iterator = key_table.find(id);
+         eosio_assert(iterator != key_table.end(), "Key id does not exist!");
 
-         /** check whether the key id exists **/
-         auto key_iterator = key_table.find(key);
-         eosio_assert(key_iterator != key_table.end(), "Key does not exist!");
+         /** make sure it is unused **/
+         eosio_assert((*iterator).version_count != UNCOUNTED, "Key usage is not counted yet, run migratekeys!");
 
-         /** add the record **/
-         enc_key_table.emplace(_self, [&](auto& enc_key_record) {
-             enc_key_record.id = id;
-             enc_key_record.key = key;
-             enc_key_record.public_key = public_key;
-             enc_key_record.iv = iv;
-             enc_key_record.nonce = nonce;
-             enc_key_record.value = value;
-         });
-      }
+         /** until migratekeys is done, old encrypted copies may be missing from by_key **/
+         key_migration_singleton_type key_migration(_self, user);
+         eosio_assert(!key_migration.exists() || key_migration.get().phase == MIGRATE_DONE, "Key migration is in progress, run migratekeys!");
+         eosio_assert((*iterator).version_count == 0, "Key is used by versions!");
 
-   // @abi action
-   void addpost(account_name account, uint64_t id, bool is_folder, uint64_t subject, string caption) {
-      post_table_type post_table(_self, _self);
-      file_table_type file_table(_self, account);
-      folder_table_type folder_table(_self, account);
+         profile_table_type profile_table(_self, user);
+         auto profile_iterator = profile_table.find(0);
+         eosio_assert(profile_iterator == profile_table.end() || (*profile_iterator).key != id, "Key is used by the profile!");
 
-      require_auth(account);
+         enc_key_table_type enc_key_table(_self, user);
+         auto enc_keys_by_key = enc_key_table.get_index<N(by_key)>();
+         eosio_assert(enc_keys_by_key.find(id) == enc_keys_by_key.end(), "Key has encrypted copies!");
 
-      /** check whether the id exists **/
-      auto post_iterator = post_table.find(id);
-      eosio_assert(post_iterator == post_table.end(), "Post id exists!");
+         /** delete the key **/
+         add_usage(user, usage_keys, -1, -int64_t(pack_size(*iterator)));
+         key_table.erase(iterator);
 
-      /** check whether subject exists **/
-      if (is_folder) {
-         auto folder_iterator = folder_table.find(subject);
-         eosio_assert(folder_iterator != folder_table.end(), "Folder does not exist!");
+         save_usage();
+      }
+
+      /**
+       * brings versions, keys and encrypted keys written before they were indexed by key up
+       * to date, up to max_count rows per call. first every version is added back, which gives
+       * it the by_key entry it is missing, then every key's versions are counted, then every
+       * encrypted key is added back for its by_key and by_pubkey entries. repeat until it
+       * asserts that the keys are migrated. it is safe to run at any time, also for users whose
+       * rows are all new.
+       */
+      // @abi action
+      void migratekeys(account_name user, uint32_t max_count) {
+         require_auth(user);
+
+         key_migration_singleton_type key_migration(_self, user);
+         key_migration_record state = key_migration.get_or_default(key_migration_record{MIGRATE_VERSIONS, 0});
+         eosio_assert(state.phase != MIGRATE_DONE, "Keys are migrated!");
+
+         version_table_type version_table(_self, user);
+         uint32_t count = 0;
+
+         if (state.phase == MIGRATE_VERSIONS) {
+            auto iterator = version_table.lower_bound(state.next);
+            for (; count < max_count && iterator != version_table.end(); ++count) {
+               const version_record version = *iterator;
+               iterator = version_table.erase(iterator);
+               version_table.emplace(ram_payer(user), [&](auto& version_record) {
+                  version_record.id = version.id;
+                  version_record.ipfs_hash = version.ipfs_hash;
+                  version_record.sha256 = version.sha256;
+                  version_record.date = version.date;
+                  version_record.file = version.file;
+                  version_record.key = version.key;
+               });
+               state.next = version.id + 1;
+            }
+
+            if (iterator == version_table.end()) {
+               state = key_migration_record{MIGRATE_KEYS, 0};
+            }
+         }
+
+         if (state.phase == MIGRATE_KEYS) {
+            key_table_type key_table(_self, user);
+            auto versions_by_key = version_table.get_index<N(by_key)>();
+            auto iterator = key_table.lower_bound(state.next);
+            for (; count < max_count && iterator != key_table.end(); ++iterator) {
+               /** a key is counted in one go, so max_count can be exceeded by the versions of one key **/
+               uint64_t versions = 0;
+               for (auto version = versions_by_key.lower_bound((*iterator).id); version != versions_by_key.end() && (*version).key == (*iterator).id; ++version) {
+                  ++versions;
+               }
+               key_table.modify(iterator, ram_payer(user), [&](auto& key_record) {
+                  key_record.version_count = versions;
+               });
+               state.next = (*iterator).id + 1;
+               count += 1 + versions;
+            }
+
+            if (iterator == key_table.end()) {
+               state = key_migration_record{MIGRATE_ENC_KEYS, 0};
+            }
+         }
+
+         if (state.phase == MIGRATE_ENC_KEYS) {
+            enc_key_table_type enc_key_table(_self, user);
+            auto iterator = enc_key_table.lower_bound(state.next);
+            for (; count < max_count && iterator != enc_key_table.end(); ++count) {
+               const enc_key_record enc_key = *iterator;
+               iterator = enc_key_table.erase(iterator);
+               enc_key_table.emplace(ram_payer(user), [&](auto& enc_key_record) {
+                  enc_key_record.id = enc_key.id;
+                  enc_key_record.key = enc_key.key;
+                  enc_key_record.public_key = enc_key.public_key;
+                  enc_key_record.iv = enc_key.iv;
+                  enc_key_record.nonce = enc_key.nonce;
+                  enc_key_record.value = enc_key.value;
+               });
+               state.next = enc_key.id + 1;
+            }
+
+            if (iterator == enc_key_table.end()) {
+               state = key_migration_record{MIGRATE_DONE, 0};
+            }
+         }
+
+         key_migration.set(state, ram_payer(user));
+      }
+
+      /**
+       * indexes the names of up to max_count folders and files written before names were
+       * indexed, folders first. names that are indexed already are left as they are. repeat
+       * until it asserts that the names are reindexed. the entries count towards the user's
+       * usage, but reindexing does not fail on a quota.
+       */
+      // @abi action
+      void reindexnames(account_name user, uint32_t max_count) {
+         require_auth(user);
+
+         name_reindex_singleton_type name_reindex(_self, user);
+         name_reindex_record state = name_reindex.get_or_default(name_reindex_record{NAME_REINDEX_FOLDERS, 0});
+         eosio_assert(state.phase != NAME_REINDEX_DONE, "Names are reindexed!");
+
+         uint32_t count = 0;
+
+         if (state.phase == NAME_REINDEX_FOLDERS) {
+            folder_table_type folder_table(_self, user);
+            auto iterator = folder_table.lower_bound(state.next);
+            for (; count < max_count && iterator != folder_table.end(); ++iterator, ++count) {
+               index_name(user, NAME_FOLDER, (*iterator).id, (*iterator).name);
+               state.next = (*iterator).id + 1;
+            }
+
+            if (iterator == folder_table.end()) {
+               state = name_reindex_record{NAME_REINDEX_FILES, 0};
+            }
+         }
+
+         if (state.phase == NAME_REINDEX_FILES) {
+            file_table_type file_table(_self, user);
+            auto iterator = file_table.lower_bound(state.next);
+            for (; count < max_count && iterator != file_table.end(); ++iterator, ++count) {
+               index_name(user, NAME_FILE, (*iterator).id, (*iterator).name);
+               state.next = (*iterator).id + 1;
+            }
+
+            if (iterator == file_table.end()) {
+               state = name_reindex_record{NAME_REINDEX_DONE, 0};
+            }
+         }
+
+         name_reindex.set(state, ram_payer(user));
+         save_usage(false);
+      }
+
+      /**
+       * counts up to max_count of a user's rows into a new usage row, table by table, for users
+       * with rows from before usage was tracked. the user's rows can't change until it is done,
+       * when the new row replaces the old one. repeat until it asserts that the usage is
+       * recounted. run by the user or the contract; when users pay for RAM, by the user.
+       */
+      // @abi action
+      void recountusage(account_name user, uint32_t max_count) {
+         if (!has_auth(user)) {
+            require_auth(_self);
+         }
+
+         usage_recount_singleton_type usage_recount(_self, user);
+         usage_recount_record state = usage_recount.get_or_default(usage_recount_record{RECOUNT_FOLDERS, 0, usage_record{}});
+         eosio_assert(state.phase != RECOUNT_DONE, "Usage is recounted!");
+
+         uint32_t budget = max_count;
+
+         if (state.phase == RECOUNT_FOLDERS) {
+            folder_table_type folder_table(_self, user);
+            if (recount_rows(folder_table, usage_folders, state, budget)) {
+               state.phase = RECOUNT_FILES;
+               state.next = 0;
+            }
+         }
+
+         if (state.phase == RECOUNT_FILES) {
+            file_table_type file_table(_self, user);
+            if (recount_rows(file_table, usage_files, state, budget)) {
+               state.phase = RECOUNT_VERSIONS;
+               state.next = 0;
+            }
+         }
+
+         if (state.phase == RECOUNT_VERSIONS) {
+            version_table_type version_table(_self, user);
+            if (recount_rows(version_table, usage_versions, state, budget)) {
+               state.phase = RECOUNT_KEYS;
+               state.next = 0;
+            }
+         }
+
+         if (state.phase == RECOUNT_KEYS) {
+            key_table_type key_table(_self, user);
+            if (recount_rows(key_table, usage_keys, state, budget)) {
+               state.phase = RECOUNT_ENC_KEYS;
+               state.next = 0;
+            }
+         }
+
+         if (state.phase == RECOUNT_ENC_KEYS) {
+            enc_key_table_type enc_key_table(_self, user);
+            if (recount_rows(enc_key_table, usage_enckeys, state, budget)) {
+               state.phase = RECOUNT_NAMES;
+               state.next = 0;
+            }
+         }
+
+         if (state.phase == RECOUNT_NAMES) {
+            /** name index entries add to the bytes of what they index, as index_name counts them **/
+            name_index_table_type name_index_table(_self, user);
+            auto iterator = name_index_table.lower_bound(state.next);
+            for (; budget > 0 && iterator != name_index_table.end(); ++iterator, --budget) {
+               state.usage.bytes(name_usage((*iterator).kind)) += pack_size(*iterator);
+               state.next = (*iterator).id + 1;
+            }
+
+            if (iterator == name_index_table.end()) {
+               usage_singleton_type(_self, user).set(state.usage, ram_payer(user));
+               state = usage_recount_record{RECOUNT_DONE, 0, usage_record{}};
+            }
+         }
+
+         usage_recount.set(state, ram_payer(user));
+      }
+
+      // @abi action
+      void addenckey(account_name user, uint64_t id, uint64_t key, const string& public_key, const string& iv, const string& nonce, const string& value) {
+         enc_key_table_type enc_key_table(_self, user);
+         key_table_type key_table(_self, user);
+
+         require_auth(user);
+
+         /** check whether the id exists **/
+         auto enc_key_iterator = enc_key_table.find(id);
+         eosio_assert(enc_key_iterator == enc_key_table.end(), "Enc key id exists!");
+
+         /** check whether the key id exists **/
+         auto key_iterator = key_table.find(key);
+         eosio_assert(key_iterator != key_table.end(), "Key does not exist!");
+
+         /** add the record **/
+         auto added = enc_key_table.emplace(ram_payer(user), [&](auto& enc_key_record) {
+             enc_key_record.id = id;
+             enc_key_record.key = key;
+             enc_key_record.public_key = public_key;
+             enc_key_record.iv = iv;
+             enc_key_record.nonce = nonce;
+             enc_key_record.value = value;
+         });
+         add_usage(user, usage_enckeys, 1, pack_size(*added));
+
+         save_usage();
+      }
+
+      /** an encrypted copy of a key, for one recipient **/
+      struct enc_key_envelope {
+         uint64_t id;
+         string public_key;
+         string iv;
+         string nonce;
+         string value;
+
+         EOSLIB_SERIALIZE(enc_key_envelope, (id)(public_key)(iv)(nonce)(value))
+      };
+
+      /** adds encrypted copies of one key for several recipients **/
+      // @abi action
+      void addenckeys(account_name user, uint64_t key, const vector<enc_key_envelope>& envelopes) {
+         enc_key_table_type enc_key_table(_self, user);
+         key_table_type key_table(_self, user);
+
+         require_auth(user);
+
+         /** check whether the key id exists, once for all envelopes **/
+         auto key_iterator = key_table.find(key);
+         eosio_assert(key_iterator != key_table.end(), "Key does not exist!");
+
+         for (const enc_key_envelope& envelope : envelopes) {
+            /** check whether the id exists **/
+            auto enc_key_iterator = enc_key_table.find(envelope.id);
+            eosio_assert(enc_key_iterator == enc_key_table.end(), "Enc key id exists!");
+
+            /** add the record **/
+            auto added = enc_key_table.emplace(ram_payer(user), [&](auto& enc_key_record) {
+                enc_key_record.id = envelope.id;
+                enc_key_record.key = key;
+                enc_key_record.public_key = envelope.public_key;
+                enc_key_record.iv = envelope.iv;
+                enc_key_record.nonce = envelope.nonce;
+                enc_key_record.value = envelope.value;
+            });
+            add_usage(user, usage_enckeys, 1, pack_size(*added));
+         }
+
+         save_usage();
+      }
+
+      /** deletes up to max_count encrypted copies of a key. repeat until none are left to revoke the key completely. **/
+      // @abi action
+      void delenckeys(account_name user, uint64_t key, uint32_t max_count) {
+         enc_key_table_type enc_key_table(_self, user);
+
+         require_auth(user);
+
+         auto enc_keys_by_key = enc_key_table.get_index<N(by_key)>();
+         auto iterator = enc_keys_by_key.lower_bound(key);
+         for (uint32_t count = 0; count < max_count && iterator != enc_keys_by_key.end() && (*iterator).key == key; ++count) {
+            add_usage(user, usage_enckeys, -1, -int64_t(pack_size(*iterator)));
+            iterator = enc_keys_by_key.erase(iterator);
+         }
+
+         save_usage();
+      }
+
+   // @abi action
+   void addpost(account_name account, uint64_t id, bool is_folder, uint64_t subject, const string& caption) {
+      post_table_type post_table(_self, _self);
+      file_table_type file_table(_self, account);
+      folder_table_type folder_table(_self, account);
+
+      require_auth(account);
+
+      /** check whether the id exists **/
+      auto post_iterator = post_table.find(id);
+      eosio_assert(post_iterator == post_table.end(), "Post id exists!");
+
+      /** check whether subject exists **/
+      if (is_folder) {
+         auto folder_iterator = folder_table.find(subject);
+         eosio_assert(folder_iterator != folder_table.end(), "Folder does not exist!");
       } else {
          auto file_iterator = file_table.find(subject);
          eosio_assert(file_iterator != file_table.end(), "File does not exist!");
       }
 
-      /** add the record **/
-      post_table.emplace(_self, [&](auto& post_record) {
-          post_record.id = id;
-          post_record.account = account;
-          post_record.is_folder = is_folder;
-          post_record.subject = subject;
-          post_record.caption = caption;
-          post_record.date = (uint64_t)now() * 1000;
-      });
-   }
+      /** add the record **/
+      const uint64_t date = (uint64_t)now() * 1000;
+      post_table.emplace(ram_payer(account), [&](auto& post_record) {
+          post_record.id = id;
+          post_record.account = account;
+          post_record.is_folder = is_folder;
+          post_record.subject = subject;
+          post_record.caption = caption;
+          post_record.date = date;
+      });
+
+      /** copy the post into each friend's inbox, unless the author has too many friends **/
+      pull_author_table_type pull_author_table(_self, _self);
+      auto pull_author_iterator = pull_author_table.find(account);
+      const bool pulled = pull_author_iterator != pull_author_table.end();
+      vector<account_name> readers;
+      if (friends_of(account, readers)) {
+         /** the author is back under MAX_FANOUT. posts from the pulled period stay in the posts index. **/
+         if (pulled) {
+            pull_author_table.erase(pull_author_iterator);
+         }
+         for (account_name reader : readers) {
+            deliver_post(reader, id, account, date);
+         }
+         return;
+      }
+
+      /** friends read this author's posts through the posts index instead **/
+      if (!pulled) {
+         pull_author_table.emplace(ram_payer(account), [&](auto& pull_author_record) {
+            pull_author_record.account = account;
+         });
+      }
+   }
+
+      /**
+       * adds back up to max_count posts, each billed as addpost bills it, which gives posts
+       * written before the by_account index their missing entry. repeat until it asserts that
+       * the posts are reindexed. when users pay for RAM it also needs the authors' authority.
+       */
+      // @abi action
+      void reindexposts(uint32_t max_count) {
+         require_auth(_self);
+
+         post_reindex_singleton_type post_reindex(_self, _self);
+         post_reindex_record state = post_reindex.get_or_default(post_reindex_record{});
+         eosio_assert(!state.done, "Posts are reindexed!");
+
+         post_table_type post_table(_self, _self);
+         auto iterator = post_table.lower_bound(state.next_id);
+         for (uint32_t count = 0; count < max_count && iterator != post_table.end(); ++count) {
+            const post_record post = *iterator;
+            iterator = post_table.erase(iterator);
+            post_table.emplace(ram_payer(post.account), [&](auto& post_record) {
+               post_record = post;
+            });
+            state.next_id = post.id + 1;
+         }
+
+         state.done = iterator == post_table.end();
+         post_reindex.set(state, _self);
+      }
+
+      /** sets per-user quotas (0 for no limit) and whether users pay for the RAM their rows use **/
+      // @abi action
+      void setconfig(uint64_t max_folders, uint64_t max_files, uint64_t max_versions, uint64_t max_keys, uint64_t max_enckeys, uint64_t max_bytes, bool user_pays_ram) {
+         require_auth(_self);
+
+         config_record new_config;
+         new_config.max_folders = max_folders;
+         new_config.max_files = max_files;
+         new_config.max_versions = max_versions;
+         new_config.max_keys = max_keys;
+         new_config.max_enckeys = max_enckeys;
+         new_config.max_bytes = max_bytes;
+         new_config.user_pays_ram = user_pays_ram;
+
+         config_singleton_type(_self, _self).set(new_config, _self);
+      }
+
+      /** gives grantee rights on a folder (NULL_ID for the whole space), replacing any earlier grant **/
+      // @abi action
+      void grant(account_name owner, uint64_t folder, account_name grantee, uint8_t rights) {
+         require_auth(owner);
+
+         eosio_assert(grantee != owner, "Cannot grant to yourself!");
+         eosio_assert(is_account(grantee), "Grantee does not exist!");
+         eosio_assert(rights != 0 && (rights & ~ACL_ALL) == 0, "Invalid rights!");
+
+         /** check whether the folder exists **/
+         if (folder != NULL_ID) {
+            folder_table_type folder_table(_self, owner);
+            eosio_assert(folder_table.find(folder) != folder_table.end(), "Folder does not exist!");
+         }
+
+         grant_table_type grant_table(_self, owner);
+         auto grants_by_target = grant_table.get_index<N(by_target)>();
+         auto iterator = grants_by_target.find(grant_target(folder, grantee));
+         if (iterator == grants_by_target.end()) {
+            grant_table.emplace(ram_payer(owner), [&](auto& grant_record) {
+               grant_record.id = grant_table.available_primary_key();
+               grant_record.folder = folder;
+               grant_record.grantee = grantee;
+               grant_record.rights = rights;
+            });
+         } else {
+            grants_by_target.modify(iterator, ram_payer(owner), [&](auto& grant_record) {
+               grant_record.rights = rights;
+            });
+         }
+
+         /** mirror the grant in the grantee's scope **/
+         share_table_type share_table(_self, grantee);
+         auto shares_by_target = share_table.get_index<N(by_target)>();
+         auto share_iterator = shares_by_target.find(grant_target(owner, folder));
+         if (share_iterator == shares_by_target.end()) {
+            share_table.emplace(ram_payer(owner), [&](auto& share_record) {
+               share_record.id = share_table.available_primary_key();
+               share_record.owner = owner;
+               share_record.folder = folder;
+               share_record.rights = rights;
+            });
+         } else {
+            shares_by_target.modify(share_iterator, ram_payer(owner), [&](auto& share_record) {
+               share_record.rights = rights;
+            });
+         }
+
+         update_acl_summary(owner, folder);
+      }
+
+      /** removes grantee's grant on a folder **/
+      // @abi action
+      void revoke(account_name owner, uint64_t folder, account_name grantee) {
+         require_auth(owner);
+
+         grant_table_type grant_table(_self, owner);
+         auto grants_by_target = grant_table.get_index<N(by_target)>();
+         auto iterator = grants_by_target.find(grant_target(folder, grantee));
+         eosio_assert(iterator != grants_by_target.end(), "Grant does not exist!");
+         grants_by_target.erase(iterator);
+
+         share_table_type share_table(_self, grantee);
+         auto shares_by_target = share_table.get_index<N(by_target)>();
+         auto share_iterator = shares_by_target.find(grant_target(owner, folder));
+         if (share_iterator != shares_by_target.end()) {
+            shares_by_target.erase(share_iterator);
+         }
+
+         update_acl_summary(owner, folder);
+      }
+
+   private:
+
+      /*
+
+      action bodies shared by the owner's actions and the grantee variants
+
+      */
+      void add_folder(account_name user, uint64_t id, const string& name, uint64_t parent_folder) {
+         /** user's scope **/
+         folder_table_type folder_table(_self, user);
+
+         /** check whether the id exists **/
+         auto iterator = folder_table.find(id);
+         eosio_assert(iterator == folder_table.end(), "Folder id exists!");
+
+         /** check whether parent exists **/
+         if (parent_folder != NULL_ID) {
+            iterator = folder_table.find(parent_folder);
+            eosio_assert(iterator != folder_table.end(), "Parent folder does not exist!");
+         }
+
+         /** make sure the name is valid **/
+         eosio_assert(!name_exists(user, name, parent_folder), "Name exists!");
+
+         /** add the record **/
+         auto added = folder_table.emplace(ram_payer(user), [&](auto& folder_record) {
+            folder_record.id = id;
+            folder_record.name = name;
+            folder_record.parent_folder = parent_folder;
+         });
+         add_usage(user, usage_folders, 1, pack_size(*added));
+         index_name(user, NAME_FOLDER, id, name);
+
+         /** hash the new (empty) folder and update its ancestors **/
+         update_hashes(user, id);
+         save_usage();
+      }
+
+      void add_file(account_name user, uint64_t id, const string& name, uint64_t parent_folder, uint64_t current_version) {
+         file_table_type file_table(_self, user);
+         folder_table_type folder_table(_self, user);
+
+         /** check whether the id exists **/
+         auto iterator = file_table.find(id);
+         eosio_assert(iterator == file_table.end(), "File id exists!");
+
+         /** check whether parent exists **/
+         if (parent_folder != NULL_ID) {
+         auto iterator = folder_table.find(parent_folder);
+            eosio_assert(iterator != folder_table.end(), "Parent folder does not exist!");
+         }
+
+         /** make sure the version is valid **/
+         eosio_assert(version_valid(user, current_version, id), "Version is not valid!");
+
+         /** make sure the name is valid **/
+         eosio_assert(!name_exists(user, name, parent_folder), "Name exists!");
+
+         /** add the record **/
+         auto added = file_table.emplace(ram_payer(user), [&](auto& file_record) {
+            file_record.id = id;
+            file_record.name = name;
+            file_record.parent_folder = parent_folder;
+            file_record.current_version = current_version;
+         });
+         add_usage(user, usage_files, 1, pack_size(*added));
+         index_name(user, NAME_FILE, id, name);
+
+         update_hashes(user, parent_folder);
+         save_usage();
+      }
+
+      void add_version(account_name user, uint64_t id, const string& ipfs_hash, const string& sha256, uint64_t date, uint64_t file, uint64_t key) {
+         file_table_type file_table(_self, user);
+         version_table_type version_table(_self, user);
+         key_table_type key_table(_self, user);
+
+         /** check whether the id exists **/
+         auto iterator = version_table.find(id);
+         eosio_assert(iterator == version_table.end(), "Version id exists!");
+
+         /** check whether file exists **/
+         if (file != NULL_ID) {
+           auto iterator = file_table.find(file);
+           eosio_assert(iterator != file_table.end(), "File does not exist!");
+         }
+
+         /** check whether key exists, and count the version against it **/
+         if (key != NULL_ID) {
+           auto iterator = key_table.find(key);
+           eosio_assert(iterator != key_table.end(), "Key does not exist!");
+           key_table.modify(iterator, ram_payer(user), [&](auto& key_record) {
+              key_record.add_versions(1);
+           });
+         }
+
+         /** add the record **/
+         auto added = version_table.emplace(ram_payer(user), [&](auto& version_record) {
+             version_record.id = id;
+             version_record.ipfs_hash = ipfs_hash;
+             version_record.sha256 = sha256;
+             version_record.date = date;
+             version_record.file = file;
+             version_record.key = key;
+         });
+         add_usage(user, usage_versions, 1, pack_size(*added));
+
+         save_usage();
+      }
+
+      void delete_file(account_name user, uint64_t id) {
+         file_table_type file_table(_self, user);
+         version_table_type version_table(_self, user);
+
+         /** get the file and make sure it exists **/
+         auto iterator = file_table.find(id);
+         eosio_assert(iterator != file_table.end(), "File id does not exist!");
+
+         /** delete all versions, counting them per key **/
+         vector<key_count> key_counts;
+         vector<uint64_t> deleted_versions;
+         vector<uint64_t> shared_versions;
+         version_ref_table_type version_ref_table(_self, user);
+         auto versions_by_file = version_table.get_index<N(by_file)>();
+         auto version_iterator = versions_by_file.lower_bound(id);
+         while (version_iterator != versions_by_file.end() && (*version_iterator).file == id) {
+            /** versions that clones still use stay until the last of them lets go **/
+            if (version_ref_table.find((*version_iterator).id) != version_ref_table.end()) {
+               shared_versions.push_back((*version_iterator).id);
+               ++version_iterator;
+               continue;
+            }
+            if ((*version_iterator).key != NULL_ID) {
+               count_key(key_counts, (*version_iterator).key);
+            }
+            deleted_versions.push_back((*version_iterator).id);
+            add_usage(user, usage_versions, -1, -int64_t(pack_size(*version_iterator)));
+            version_iterator = versions_by_file.erase(version_iterator);
+         }
+
+         /** the file id may be reused, so the kept versions no longer belong to it **/
+         for (uint64_t version : shared_versions) {
+            version_table.modify(version_table.find(version), ram_payer(user), [&](auto& version_record) {
+               version_record.file = NULL_ID;
+            });
+         }
+
+         /** a clone lets go of the version it shares **/
+         release_shared_version(user, id, key_counts, deleted_versions);
+
+         purge_likes(user, deleted_versions);
+
+         /** release the keys **/
+         key_table_type key_table(_self, user);
+         for (const key_count& counted : key_counts) {
+            auto key_iterator = key_table.find(counted.key);
+            if (key_iterator != key_table.end()) {
+               key_table.modify(key_iterator, ram_payer(user), [&](auto& key_record) {
+                  key_record.add_versions(-int64_t(counted.count));
+               });
+            }
+         }
+
+         const uint64_t parent_folder = (*iterator).parent_folder;
+
+         /** delete the file itself **/
+         add_usage(user, usage_files, -1, -int64_t(pack_size(*iterator)));
+         file_table.erase(iterator);
+         unindex_name(user, NAME_FILE, id);
+
+         update_hashes(user, parent_folder);
+         save_usage();
+      }
+
+      /**
+       * copies up to budget folders and files of the clone in progress, breadth first. each queue
+       * entry is a folder whose children still have to be copied: its subfolders, then its files.
+       * a folder's hash is computed when its entry is done, and again as each folder below it is
+       * done, so it matches once the whole copy is.
+       */
+      void clone_step(account_name user, uint32_t budget) {
+         clone_job_singleton_type clone_job(_self, user);
+         clone_job_record job = clone_job.get();
+
+         folder_table_type folder_table(_self, user);
+         file_table_type file_table(_self, user);
+         clone_queue_table_type clone_queue_table(_self, user);
+         auto folders_by_parent = folder_table.get_index<N(by_parent)>();
+         auto files_by_parent = file_table.get_index<N(by_parent)>();
+
+         while (budget > 0) {
+            auto entry = clone_queue_table.begin();
+            if (entry == clone_queue_table.end()) {
+               clone_job.remove();
+               return;
+            }
+
+            /** the copy was deleted meanwhile **/
+            if (folder_table.find((*entry).target) == folder_table.end()) {
+               clone_queue_table.erase(entry);
+               continue;
+            }
+
+            const uint64_t source = (*entry).source;
+            const uint64_t target = (*entry).target;
+            uint64_t last_child = (*entry).last_child;
+            bool done = false;
+
+            if ((*entry).phase == CLONE_PHASE_FOLDERS) {
+               auto iterator = resume_children(folder_table, folders_by_parent, source, last_child);
+               for (; budget > 0 && iterator != folders_by_parent.end() && (*iterator).parent_folder == source; ++iterator, --budget) {
+                  const uint64_t id = (*iterator).id + job.id_offset;
+                  eosio_assert(folder_table.find(id) == folder_table.end(), "Folder id exists!");
+
+                  auto added = folder_table.emplace(ram_payer(user), [&](auto& folder_record) {
+                     folder_record.id = id;
+                     folder_record.name = (*iterator).name;
+                     folder_record.parent_folder = target;
+                  });
+                  add_usage(user, usage_folders, 1, pack_size(*added));
+                  index_name(user, NAME_FOLDER, id, (*iterator).name);
+
+                  clone_queue_table.emplace(ram_payer(user), [&](auto& clone_queue_record) {
+                     clone_queue_record.id = clone_queue_table.available_primary_key();
+                     clone_queue_record.source = (*iterator).id;
+                     clone_queue_record.target = id;
+                     clone_queue_record.last_child = NULL_ID;
+                     clone_queue_record.phase = CLONE_PHASE_FOLDERS;
+                  });
+
+                  last_child = (*iterator).id;
+                  ++job.copied;
+               }
+
+               if (iterator == folders_by_parent.end() || (*iterator).parent_folder != source) {
+                  /** on to the files **/
+                  clone_queue_table.modify(entry, ram_payer(user), [&](auto& clone_queue_record) {
+                     clone_queue_record.phase = CLONE_PHASE_FILES;
+                     clone_queue_record.last_child = NULL_ID;
+                  });
+                  continue;
+               }
+            } else {
+               auto iterator = resume_children(file_table, files_by_parent, source, last_child);
+               for (; budget > 0 && iterator != files_by_parent.end() && (*iterator).parent_folder == source; ++iterator, --budget) {
+                  const uint64_t id = (*iterator).id + job.id_offset;
+                  eosio_assert(file_table.find(id) == file_table.end(), "File id exists!");
+
+                  auto added = file_table.emplace(ram_payer(user), [&](auto& file_record) {
+                     file_record.id = id;
+                     file_record.name = (*iterator).name;
+                     file_record.parent_folder = target;
+                     file_record.current_version = (*iterator).current_version;
+                  });
+                  add_usage(user, usage_files, 1, pack_size(*added));
+                  index_name(user, NAME_FILE, id, (*iterator).name);
+                  if ((*iterator).current_version != NULL_ID) {
+                     share_version(user, id, (*iterator).current_version);
+                  }
+
+                  last_child = (*iterator).id;
+                  ++job.copied;
+               }
+
+               done = iterator == files_by_parent.end() || (*iterator).parent_folder != source;
+            }
+
+            if (done) {
+               clone_queue_table.erase(entry);
+               update_hashes(user, target);
+            } else {
+               clone_queue_table.modify(entry, ram_payer(user), [&](auto& clone_queue_record) {
+                  clone_queue_record.last_child = last_child;
+               });
+            }
+         }
+
+         clone_job.set(job, ram_payer(user));
+      }
+
+      /**
+       * the first child of parent after last_child, in by_parent order (by id within a parent).
+       * when last_child is still there this is a single lookup.
+       */
+      template<typename Table, typename Index>
+      static auto resume_children(Table& table, Index& by_parent, uint64_t parent, uint64_t last_child) -> decltype(by_parent.lower_bound(parent)) {
+         if (last_child == NULL_ID) {
+            return by_parent.lower_bound(parent);
+         }
+
+         auto last = table.find(last_child);
+         if (last != table.end() && (*last).parent_folder == parent) {
+            return ++by_parent.iterator_to(*last);
+         }
+
+         /** it was moved or deleted meanwhile **/
+         auto iterator = by_parent.lower_bound(parent);
+         while (iterator != by_parent.end() && (*iterator).parent_folder == parent && (*iterator).id <= last_child) {
+            ++iterator;
+         }
+         return iterator;
+      }
+
+      /** lets a cloned file use another file's version, counting the reference **/
+      void share_version(account_name user, uint64_t file, uint64_t version) {
+         shared_version_table_type shared_version_table(_self, user);
+         shared_version_table.emplace(ram_payer(user), [&](auto& shared_version_record) {
+            shared_version_record.file = file;
+            shared_version_record.version = version;
+         });
+
+         version_ref_table_type version_ref_table(_self, user);
+         auto iterator = version_ref_table.find(version);
+         if (iterator == version_ref_table.end()) {
+            version_ref_table.emplace(ram_payer(user), [&](auto& version_ref_record) {
+               version_ref_record.version = version;
+               version_ref_record.refs = 1;
+            });
+         } else {
+            version_ref_table.modify(iterator, ram_payer(user), [&](auto& version_ref_record) {
+               version_ref_record.refs += 1;
+            });
+         }
+      }
+
+      /** erases the likes of deleted versions, up to LIKE_PURGE_BATCH. versions with likes left over are queued. **/
+      void purge_likes(account_name user, const vector<uint64_t>& versions) {
+         like_table_type like_table(_self, _self);
+         auto likes_by_target = like_table.get_index<N(by_target)>();
+         like_purge_table_type like_purge_table(_self, _self);
+
+         uint32_t budget = LIKE_PURGE_BATCH;
+         bool queued = false;
+         for (uint64_t version : versions) {
+            if (erase_likes(likes_by_target, user, version, budget)) {
+               continue;
+            }
+            like_purge_table.emplace(_self, [&](auto& like_purge_record) {
+               like_purge_record.id = like_purge_table.available_primary_key();
+               like_purge_record.liked = user;
+               like_purge_record.version = version;
+            });
+            queued = true;
+         }
+
+         if (queued) {
+            schedule_like_purge();
+         }
+      }
+
+      /** erases the likes of one version while the budget lasts. returns true when none are left. **/
+      template<typename Index>
+      static bool erase_likes(Index& likes_by_target, account_name liked, uint64_t version, uint32_t& budget) {
+         const uint128_t target = inspace::like_target(liked, version);
+         auto iterator = likes_by_target.lower_bound(target);
+         while (iterator != likes_by_target.end() && (*iterator).get_target() == target) {
+            if (budget == 0) {
+               return false;
+            }
+            iterator = likes_by_target.erase(iterator);
+            --budget;
+         }
+         return true;
+      }
+
+      void schedule_like_purge() {
+         transaction out;
+         out.actions.emplace_back(
+            permission_level{_self, N(active)},
+            _self,
+            N(purgelikes),
+            std::make_tuple(LIKE_PURGE_BATCH));
+         out.delay_sec = 1;
+         out.send(N(purgelikes), _self, true); // replaces the pending run, so only one is ever scheduled
+      }
+
+      /** collects the friends of an account. returns false if there are more than MAX_FANOUT. **/
+      bool friends_of(account_name account, vector<account_name>& result) {
+         inspace::friendship_table_type friendship_table(FRIENDS_ACCOUNT, FRIENDS_ACCOUNT);
+
+         auto friendships_by_account1 = friendship_table.get_index<N(by_account1)>();
+         for (auto iterator = friendships_by_account1.lower_bound(account); iterator != friendships_by_account1.end() && (*iterator).account1 == account; ++iterator) {
+            if (result.size() == MAX_FANOUT) {
+               return false;
+            }
+            result.push_back((*iterator).account2);
+         }
+
+         auto friendships_by_account2 = friendship_table.get_index<N(by_account2)>();
+         for (auto iterator = friendships_by_account2.lower_bound(account); iterator != friendships_by_account2.end() && (*iterator).account2 == account; ++iterator) {
+            if (result.size() == MAX_FANOUT) {
+               return false;
+            }
+            result.push_back((*iterator).account1);
+         }
+
+         return true;
+      }
+
+      /** appends a post to a reader's inbox and trims the oldest entries beyond MAX_INBOX_LENGTH **/
+      void deliver_post(account_name reader, uint64_t post_id, account_name author, uint64_t date) {
+         inbox_table_type inbox_table(_self, reader);
+
+         /** ids only grow and only the oldest are erased, so they stay contiguous **/
+         const uint64_t newest = inbox_table.available_primary_key();
+         inbox_table.emplace(ram_payer(author), [&](auto& inbox_record) {
+            inbox_record.id = newest;
+            inbox_record.post_id = post_id;
+            inbox_record.author = author;
+            inbox_record.date = date;
+         });
+
+         auto iterator = inbox_table.begin();
+         for (uint32_t count = 0; count < INBOX_TRIM_BATCH && newest - (*iterator).id >= MAX_INBOX_LENGTH; ++count) {
+            iterator = inbox_table.erase(iterator);
+         }
+      }
+
+      static uint128_t grant_target(uint64_t high, uint64_t low) {
+         return (uint128_t(high) << 64) | low;
+      }
+
+      /** the folder holding a file, which is what a grantee's rights on the file are checked against **/
+      uint64_t file_parent(account_name owner, uint64_t file) {
+         file_table_type file_table(_self, owner);
+         return file_table.get(file, "File id does not exist!").parent_folder;
+      }
+
+      /**
+       * authorizes grantee to act in owner's space below folder. rights are inherited, so the
+       * grants on the folder and its ancestors are combined. only folders whose summary shows
+       * a grant are looked up in the grants table, and the walk is bounded by MAX_FOLDER_DEPTH.
+       */
+      void require_grant(account_name grantee, account_name owner, uint64_t folder, uint8_t rights) {
+         require_auth(grantee);
+         eosio_assert(grantee != owner, "Use the owner's action!");
+
+         folder_table_type folder_table(_self, owner);
+         acl_summary_table_type acl_summary_table(_self, owner);
+         grant_table_type grant_table(_self, owner);
+         auto grants_by_target = grant_table.get_index<N(by_target)>();
+
+         uint8_t granted = 0;
+         for (uint32_t depth = 0; ; ++depth) {
+            eosio_assert(depth <= MAX_FOLDER_DEPTH, "Folder tree is too deep!");
+
+            auto summary_iterator = acl_summary_table.find(folder);
+            if (summary_iterator != acl_summary_table.end() && ((*summary_iterator).rights & rights & ~granted) != 0) {
+               auto iterator = grants_by_target.find(grant_target(folder, grantee));
+               if (iterator != grants_by_target.end()) {
+                  granted |= (*iterator).rights;
+                  if ((granted & rights) == rights) {
+                     break;
+                  }
+               }
+            }
+
+            eosio_assert(folder != NULL_ID, "Not authorized!");
+            folder = folder_table.get(folder, "Folder id does not exist!").parent_folder;
+         }
+
+         /** rows the grantee adds are billed to the grantee **/
+         acting_grantee = grantee;
+      }
+
+      /** recomputes the union of the rights granted on a folder, or removes the summary if there are none **/
+      void update_acl_summary(account_name owner, uint64_t folder) {
+         grant_table_type grant_table(_self, owner);
+         auto grants_by_target = grant_table.get_index<N(by_target)>();
+
+         uint8_t rights = 0;
+         uint64_t grant_count = 0;
+         for (auto iterator = grants_by_target.lower_bound(grant_target(folder, 0)); iterator != grants_by_target.end() && (*iterator).folder == folder; ++iterator) {
+            rights |= (*iterator).rights;
+            ++grant_count;
+         }
+
+         acl_summary_table_type acl_summary_table(_self, owner);
+         auto iterator = acl_summary_table.find(folder);
+         if (grant_count == 0) {
+            if (iterator != acl_summary_table.end()) {
+               acl_summary_table.erase(iterator);
+            }
+         } else if (iterator == acl_summary_table.end()) {
+            acl_summary_table.emplace(ram_payer(owner), [&](auto& acl_summary_record) {
+               acl_summary_record.folder = folder;
+               acl_summary_record.rights = rights;
+               acl_summary_record.grant_count = grant_count;
+            });
+         } else {
+            acl_summary_table.modify(iterator, ram_payer(owner), [&](auto& acl_summary_record) {
+               acl_summary_record.rights = rights;
+               acl_summary_record.grant_count = grant_count;
+            });
+         }
+      }
+
+      bool version_valid(account_name user, uint64_t id, uint64_t file) {
+         if (id == NULL_ID) {
+            return true;
+         }
+
+         version_table_type version_table(_self, user);
+
+         /** check whether the id exists **/
+         auto iterator = version_table.find(id);
+         if (iterator == version_table.end()) {
+            return false;
+         }
+
+         /** check whether the version's file is correct, or the file is a clone sharing it **/
+         if ((*iterator).file != file) {
+            shared_version_table_type shared_version_table(_self, user);
+            auto shared_iterator = shared_version_table.find(file);
+            return shared_iterator != shared_version_table.end() && (*shared_iterator).version == id;
+         }
+
+         return true;
+      }
+
+      /** returns true if a file or folder with the name already exists in the given folder **/
+      bool name_exists(account_name user, const string& name, uint64_t folder_id) {
+         folder_table_type folder_table(_self, user);
+         auto folders_by_parent = folder_table.get_index<N(by_parent)>();
+
+         /** only the folder's own children. names are compared in place, without copies. **/
+         for (auto iterator = folders_by_parent.lower_bound(folder_id); iterator != folders_by_parent.end() && (*iterator).parent_folder == folder_id; ++iterator) {
+            if ((*iterator).name == name) {
+               return true;
+            }
+         }
+
+         file_table_type file_table(_self, user);
+         auto files_by_parent = file_table.get_index<N(by_parent)>();
+
+         for (auto iterator = files_by_parent.lower_bound(folder_id); iterator != files_by_parent.end() && (*iterator).parent_folder == folder_id; ++iterator) {
+            if ((*iterator).name == name) {
+               return true;
+            }
+         }
+
+         return false;
+      }
+
+      /** the kinds of row counted in a user's usage **/
+      enum usage_kind {
+         usage_folders,
+         usage_files,
+         usage_versions,
+         usage_keys,
+         usage_enckeys
+      };
+
+      /** number of versions seen for a key **/
+      struct key_count {
+         uint64_t key;
+         uint64_t count;
+      };
+
+      static void count_key(vector<key_count>& key_counts, uint64_t key) {
+         for (key_count& counted : key_counts) {
+            if (counted.key == key) {
+               counted.count += 1;
+               return;
+            }
+         }
+         key_counts.push_back(key_count{key, 1});
+      }
+
+      /**
+       * drops a cloned file's reference to the version it shares. the last reference to a version
+       * whose own file is gone deletes it, adding it to key_counts and deleted_versions.
+       */
+      void release_shared_version(account_name user, uint64_t file, vector<key_count>& key_counts, vector<uint64_t>& deleted_versions) {
+         shared_version_table_type shared_version_table(_self, user);
+         auto shared_iterator = shared_version_table.find(file);
+         if (shared_iterator == shared_version_table.end()) {
+            return;
+         }
+         const uint64_t version = (*shared_iterator).version;
+         shared_version_table.erase(shared_iterator);
+
+         version_ref_table_type version_ref_table(_self, user);
+         auto ref_iterator = version_ref_table.find(version);
+         if (ref_iterator == version_ref_table.end()) {
+            return;
+         }
+         if ((*ref_iterator).refs > 1) {
+            version_ref_table.modify(ref_iterator, ram_payer(user), [&](auto& version_ref_record) {
+               version_ref_record.refs -= 1;
+            });
+            return;
+         }
+         version_ref_table.erase(ref_iterator);
+
+         version_table_type version_table(_self, user);
+         auto version_iterator = version_table.find(version);
+         if (version_iterator == version_table.end() || (*version_iterator).file != NULL_ID) {
+            return;
+         }
+         if ((*version_iterator).key != NULL_ID) {
+            count_key(key_counts, (*version_iterator).key);
+         }
+         deleted_versions.push_back(version);
+         add_usage(user, usage_versions, -1, -int64_t(pack_size(*version_iterator)));
+         version_table.erase(version_iterator);
+      }
+
+      /** 64-bit FNV-1a, used to compare names in memory and to index public keys **/
+      static uint64_t string_hash(const string& str) {
+         uint64_t hash = 14695981039346656037ULL;
+         for (const char c : str) {
+            hash = (hash ^ (uint8_t)c) * 1099511628211ULL;
+         }
+         return hash;
+      }
 
-   private:
+      /**
+       * splits a name into its words: runs of letters, digits and non-ASCII bytes, lowercased.
+       * each token is the word's first 8 bytes, big-endian and zero-padded, so the tokens of all
+       * words starting with a prefix form one range: from the prefix padded with zeros to the
+       * prefix padded with 0xff.
+       */
+      static void name_tokens(const string& name, vector<uint64_t>& tokens) {
+         uint64_t token = 0;
+         uint32_t length = 0;
+         for (size_t i = 0; i <= name.size() && tokens.size() < MAX_NAME_TOKENS; ++i) {
+            uint8_t c = i < name.size() ? (uint8_t)name[i] : ' ';
+            const bool word = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+            if (word) {
+               if (c >= 'A' && c <= 'Z') {
+                  c += 'a' - 'A';
+               }
+               if (length < 8) {
+                  token |= uint64_t(c) << (56 - 8 * length);
+               }
+               ++length;
+               continue;
+            }
+            if (length != 0 && find(tokens.begin(), tokens.end(), token) == tokens.end()) {
+               tokens.push_back(token);
+            }
+            token = 0;
+            length = 0;
+         }
+      }
 
-      bool version_valid(account_name user, uint64_t id, uint64_t file) {
-         if (id == NULL_ID) {
-            return true;
+      static uint128_t name_target(uint8_t kind, uint64_t id) {
+         return (uint128_t(kind) << 64) | id;
+      }
+
+      /** makes the nameindex entries of a folder or file match its name. existing entries are reused. **/
+      void index_name(account_name user, uint8_t kind, uint64_t id, const string& name) {
+         vector<uint64_t> tokens;
+         name_tokens(name, tokens);
+
+         name_index_table_type name_index_table(_self, user);
+         auto entries_by_target = name_index_table.get_index<N(by_target)>();
+         const uint128_t target = name_target(kind, id);
+         const usage_kind usage_of = name_usage(kind);
+
+         /** keep entries whose token is still in the name, and give the others a new token or drop them **/
+         vector<uint64_t> stale;
+         for (auto iterator = entries_by_target.lower_bound(target); iterator != entries_by_target.end() && (*iterator).get_target() == target; ++iterator) {
+            auto token = find(tokens.begin(), tokens.end(), (*iterator).token);
+            if (token != tokens.end()) {
+               tokens.erase(token);
+            } else {
+               stale.push_back((*iterator).id);
+            }
          }
 
-         version_table_type version_table(_self, user);
+         for (uint64_t entry_id : stale) {
+            auto iterator = name_index_table.find(entry_id);
+            if (tokens.empty()) {
+               add_usage(user, usage_of, 0, -int64_t(pack_size(*iterator)));
+               name_index_table.erase(iterator);
+               continue;
+            }
+            name_index_table.modify(iterator, ram_payer(user), [&](auto& name_token_record) {
+               name_token_record.token = tokens.back();
+            });
+            tokens.pop_back();
+         }
 
-         /** check whether the id exists **/
-         auto iterator = version_table.find(id);
-         if (iterator == version_table.end()) {
-            return false;
+         for (uint64_t token : tokens) {
+            auto added = name_index_table.emplace(ram_payer(user), [&](auto& name_token_record) {
+               name_token_record.id = name_index_table.available_primary_key();
+               name_token_record.token = token;
+               name_token_record.kind = kind;
+               name_token_record.target = id;
+            });
+            add_usage(user, usage_of, 0, pack_size(*added));
          }
+      }
 
-         /** check whether the version's file is correct **/
-         if ((*iterator).file != file) {
-            return false;
+      void unindex_name(account_name user, uint8_t kind, uint64_t id) {
+         name_index_table_type name_index_table(_self, user);
+         auto entries_by_target = name_index_table.get_index<N(by_target)>();
+         const uint128_t target = name_target(kind, id);
+         const usage_kind usage_of = name_usage(kind);
+
+         auto iterator = entries_by_target.lower_bound(target);
+         while (iterator != entries_by_target.end() && (*iterator).get_target() == target) {
+            add_usage(user, usage_of, 0, -int64_t(pack_size(*iterator)));
+            iterator = entries_by_target.erase(iterator);
          }
+      }
 
-         return true;
+      /** name index entries count towards the bytes of the folders or files they index **/
+      static usage_kind name_usage(uint8_t kind) {
+         return kind == NAME_FOLDER ? usage_folders : usage_files;
       }
 
-      /** returns false if a file or folder with the name already exists in the given folder **/
-      bool name_exists(account_name user, string name, uint64_t folder_id) {
+      /** returns true if two imported nodes, or an imported node and an existing child of the base folder, share a parent and a name **/
+      bool import_names_clash(account_name user, uint64_t base_folder, const vector<import_node>& nodes, const vector<uint64_t>& parents) {
+         struct name_key {
+            uint64_t parent;
+            uint64_t hash;
+            const string* name;
+         };
+
+         vector<name_key> keys;
+         keys.reserve(nodes.size());
+
+         /** the names point into the table rows, which live as long as the tables **/
          folder_table_type folder_table(_self, user);
          auto folders_by_parent = folder_table.get_index<N(by_parent)>();
+         for (auto iterator = folders_by_parent.lower_bound(base_folder); iterator != folders_by_parent.end() && (*iterator).parent_folder == base_folder; ++iterator) {
+            keys.push_back(name_key{base_folder, string_hash((*iterator).name), &(*iterator).name});
+         }
 
-         for (auto iterator = folders_by_parent.find(folder_id); iterator != folders_by_parent.end(); ++iterator) {
-            const string this_name = (*iterator).name;
-            if (name == this_name) {
-               return true;
+         file_table_type file_table(_self, user);
+         auto files_by_parent = file_table.get_index<N(by_parent)>();
+         for (auto iterator = files_by_parent.lower_bound(base_folder); iterator != files_by_parent.end() && (*iterator).parent_folder == base_folder; ++iterator) {
+            keys.push_back(name_key{base_folder, string_hash((*iterator).name), &(*iterator).name});
+         }
+
+         for (size_t i = 0; i < nodes.size(); ++i) {
+            keys.push_back(name_key{parents[i], string_hash(nodes[i].name), &nodes[i].name});
+         }
+
+         sort(keys.begin(), keys.end(), [](const name_key& a, const name_key& b) {
+            return a.parent < b.parent || (a.parent == b.parent && a.hash < b.hash);
+         });
+
+         /** equal hashes are adjacent. compare the names themselves to rule out collisions. **/
+         for (size_t i = 1; i < keys.size(); ++i) {
+            for (size_t j = i; j-- > 0 && keys[j].parent == keys[i].parent && keys[j].hash == keys[i].hash; ) {
+               if (*keys[j].name == *keys[i].name) {
+                  return true;
+               }
             }
          }
 
+         return false;
+      }
+
+      /** an entry of a folder listing, as fed into the folder hash. the strings point into the table rows. **/
+      struct hash_entry {
+         const string* name;
+         bool is_folder;
+         checksum256 folder_hash;       /** folders only **/
+         const string* version_sha256;  /** files only: sha256 of the current version, or nullptr **/
+      };
+
+      /** serializes the entries as a vector of (name, is_folder, content) with content a string **/
+      template<typename DataStream>
+      static void pack_hash_entries(DataStream& ds, const vector<hash_entry>& entries) {
+         ds << unsigned_int(entries.size());
+         for (const hash_entry& entry : entries) {
+            ds << *entry.name << entry.is_folder;
+            if (entry.is_folder) {
+               ds << unsigned_int(sizeof(entry.folder_hash.hash));
+               ds.write((const char*)entry.folder_hash.hash, sizeof(entry.folder_hash.hash));
+            } else if (entry.version_sha256 != nullptr) {
+               ds << *entry.version_sha256;
+            } else {
+               ds << unsigned_int(0);
+            }
+         }
+      }
+
+      /** returns the stored hash of a folder, computing it if the folder predates hashing **/
+      checksum256 child_hash(account_name user, uint64_t folder_id, uint32_t depth) {
+         folder_hash_table_type folder_hash_table(_self, user);
+
+         auto iterator = folder_hash_table.find(folder_id);
+         if (iterator != folder_hash_table.end()) {
+            return (*iterator).hash;
+         }
+
+         return folder_hash(user, folder_id, depth + 1);
+      }
+
+      /** hashes the sorted (name, kind, content) entries of a folder's children **/
+      checksum256 folder_hash(account_name user, uint64_t folder_id, uint32_t depth = 0) {
+         eosio_assert(depth <= MAX_FOLDER_DEPTH, "Folder tree is too deep!");
+
+         vector<hash_entry> entries;
+
+         folder_table_type folder_table(_self, user);
+         auto folders_by_parent = folder_table.get_index<N(by_parent)>();
+
+         for (auto iterator = folders_by_parent.lower_bound(folder_id); iterator != folders_by_parent.end() && (*iterator).parent_folder == folder_id; ++iterator) {
+            entries.push_back(hash_entry{&(*iterator).name, true, child_hash(user, (*iterator).id, depth), nullptr});
+         }
+
          file_table_type file_table(_self, user);
+         version_table_type version_table(_self, user);
          auto files_by_parent = file_table.get_index<N(by_parent)>();
 
-         for (auto iterator = files_by_parent.find(folder_id); iterator != files_by_parent.end(); ++iterator) {
-            const string this_name = (*iterator).name;
-            if (name == this_name) {
-               return true;
+         for (auto iterator = files_by_parent.lower_bound(folder_id); iterator != files_by_parent.end() && (*iterator).parent_folder == folder_id; ++iterator) {
+            hash_entry entry{&(*iterator).name, false, checksum256(), nullptr};
+
+            if ((*iterator).current_version != NULL_ID) {
+               auto version_iterator = version_table.find((*iterator).current_version);
+               if (version_iterator != version_table.end()) {
+                  entry.version_sha256 = &(*version_iterator).sha256;
+               }
             }
+
+            entries.push_back(entry);
          }
 
-         return false;
+         /** names are unique within a folder, so this gives a canonical order **/
+         sort(entries.begin(), entries.end(), [](const hash_entry& a, const hash_entry& b) {
+            return *a.name < *b.name;
+         });
+
+         datastream<size_t> size_stream;
+         pack_hash_entries(size_stream, entries);
+
+         vector<char> data(size_stream.tellp());
+         datastream<char*> data_stream(data.data(), data.size());
+         pack_hash_entries(data_stream, entries);
+
+         checksum256 hash;
+         sha256(data.data(), data.size(), &hash);
+         return hash;
+      }
+
+      /** rehashes a folder and each of its ancestors, up to the user's root hash **/
+      void update_hashes(account_name user, uint64_t folder_id) {
+         folder_table_type folder_table(_self, user);
+         folder_hash_table_type folder_hash_table(_self, user);
+
+         for (uint32_t depth = 0; ; ++depth) {
+            eosio_assert(depth <= MAX_FOLDER_DEPTH, "Folder tree is too deep!");
+
+            const checksum256 hash = folder_hash(user, folder_id);
+
+            if (folder_id == NULL_ID) {
+               root_hash_singleton_type root_hash(_self, user);
+               root_hash.set(root_hash_record{hash}, ram_payer(user));
+               return;
+            }
+
+            auto hash_iterator = folder_hash_table.find(folder_id);
+            if (hash_iterator == folder_hash_table.end()) {
+               folder_hash_table.emplace(ram_payer(user), [&](auto& folder_hash_record) {
+                  folder_hash_record.id = folder_id;
+                  folder_hash_record.hash = hash;
+               });
+            } else {
+               folder_hash_table.modify(hash_iterator, ram_payer(user), [&](auto& folder_hash_record) {
+                  folder_hash_record.hash = hash;
+               });
+            }
+
+            folder_id = folder_table.get(folder_id, "Folder id does not exist!").parent_folder;
+         }
       }
 
       /*
@@ -473,7 +2127,7 @@ class filespace : public contract {
          auto primary_key() const { return id; }
          uint64_t get_parent() const { return parent_folder; }
 
-         EOSLIB_SERIALIZE(folder_record, (id)(name)(parent_folder))
+         EOSLIB_SERIALIZE_LAYOUT(folder_record, inspace::folder_layout, (id)(name)(parent_folder))
       };
 
       // @abi table files
@@ -486,7 +2140,7 @@ class filespace : public contract {
          auto primary_key() const { return id; }
          uint64_t get_parent() const { return parent_folder; }
 
-         EOSLIB_SERIALIZE(file_record, (id)(name)(parent_folder)(current_version))
+         EOSLIB_SERIALIZE_LAYOUT(file_record, inspace::file_layout, (id)(name)(parent_folder)(current_version))
       };
 
       // @abi table versions
@@ -500,21 +2154,13 @@ class filespace : public contract {
 
          auto primary_key() const { return id; }
          uint64_t get_file() const { return file; }
+         uint64_t get_key() const { return key; }
 
-         EOSLIB_SERIALIZE(version_record, (id)(ipfs_hash)(sha256)(date)(file)(key))
+         EOSLIB_SERIALIZE_LAYOUT(version_record, inspace::version_layout, (id)(ipfs_hash)(sha256)(date)(file)(key))
       };
 
-      // @abi table likes
-      struct like_record {
-         uint64_t id;
-         account_name liker;
-         account_name liked;
-         uint64_t version;
-
-         auto primary_key() const { return id; }
-
-         EOSLIB_SERIALIZE(like_record, (id)(liker)(liked)(version))
-      };
+      /** likes are shared with iscoin. see common/likes.hpp. **/
+      typedef inspace::like_record like_record;
 
       // @abi table profiles
       struct profile_record {
@@ -524,17 +2170,42 @@ class filespace : public contract {
 
          auto primary_key() const { return id; }
 
-         EOSLIB_SERIALIZE(profile_record, (id)(ipfs_hash)(key))
+         EOSLIB_SERIALIZE_LAYOUT(profile_record, inspace::profile_layout, (id)(ipfs_hash)(key))
       };
 
       // @abi table keys
       struct key_record {
          uint64_t id;
          string iv;
+         uint64_t version_count; /** number of versions encrypted with the key, or UNCOUNTED **/
 
          auto primary_key() const { return id; }
 
-         EOSLIB_SERIALIZE(key_record, (id)(iv))
+         /** never goes below zero, and leaves an UNCOUNTED key for migratekeys **/
+         void add_versions(int64_t change) {
+            if (version_count == UNCOUNTED) {
+               return;
+            }
+            version_count = (change < 0 && version_count < uint64_t(-change)) ? 0 : version_count + change;
+         }
+
+         EOSLIB_CHECK_LAYOUT(key_record, inspace::key_layout, (id)(iv)(version_count))
+
+         template<typename DataStream>
+         friend DataStream& operator<<(DataStream& ds, const key_record& t) {
+            return ds << t.id << t.iv << t.version_count;
+         }
+
+         /** rows written before versions were counted end after iv **/
+         template<typename DataStream>
+         friend DataStream& operator>>(DataStream& ds, key_record& t) {
+            ds >> t.id >> t.iv;
+            t.version_count = UNCOUNTED;
+            if (ds.remaining() >= sizeof(t.version_count)) {
+               ds >> t.version_count;
+            }
+            return ds;
+         }
       };
 
       // @abi table enckeys
@@ -547,8 +2218,10 @@ class filespace : public contract {
          string value;
 
          auto primary_key() const { return id; }
+         uint64_t get_key() const { return key; }
+         uint64_t get_public_key_hash() const { return string_hash(public_key); }
 
-         EOSLIB_SERIALIZE(enc_key_record, (id)(key)(public_key)(iv)(nonce)(value))
+         EOSLIB_SERIALIZE_LAYOUT(enc_key_record, inspace::enc_key_layout, (id)(key)(public_key)(iv)(nonce)(value))
       };
 
       // @abi table posts
@@ -561,8 +2234,289 @@ class filespace : public contract {
          uint64_t date;
 
          auto primary_key() const { return id; }
+         account_name get_account() const { return account; }
+
+         EOSLIB_SERIALIZE_LAYOUT(post_record, inspace::post_layout, (id)(account)(is_folder)(subject)(caption)(date))
+      };
+
+      /** a post delivered to a friend of its author, oldest first. in the friend's scope. **/
+      // @abi table inbox
+      struct inbox_record {
+         uint64_t id;
+         uint64_t post_id;
+         account_name author;
+         uint64_t date;
+
+         auto primary_key() const { return id; }
+
+         EOSLIB_CHECK_LAYOUT(inbox_record, inspace::inbox_layout, (id)(post_id)(author)(date))
+         EOSLIB_SERIALIZE_FIXED(inbox_record, (id)(post_id)(author)(date))
+      };
+
+      /** authors with too many friends to fan out to. their friends read posts by_account. **/
+      // @abi table pullauthors
+      struct pull_author_record {
+         account_name account;
+
+         auto primary_key() const { return account; }
+
+         EOSLIB_SERIALIZE_LAYOUT(pull_author_record, inspace::pull_author_layout, (account))
+      };
+
+      // @abi table folderhashes
+      struct folder_hash_record {
+         uint64_t id; /** folder id **/
+         checksum256 hash;
+
+         auto primary_key() const { return id; }
+
+         EOSLIB_SERIALIZE_LAYOUT(folder_hash_record, inspace::folder_hash_layout, (id)(hash))
+      };
+
+      // @abi table roothash
+      struct root_hash_record {
+         checksum256 hash;
+
+         EOSLIB_SERIALIZE_LAYOUT(root_hash_record, inspace::root_hash_layout, (hash))
+      };
+
+      /** rights given to another account on a folder. in the owner's scope. **/
+      // @abi table grants
+      struct grant_record {
+         uint64_t id;
+         uint64_t folder;
+         account_name grantee;
+         uint8_t rights;
+
+         auto primary_key() const { return id; }
+         uint128_t get_target() const { return grant_target(folder, grantee); }
+
+         EOSLIB_SERIALIZE_LAYOUT(grant_record, inspace::grant_layout, (id)(folder)(grantee)(rights))
+      };
+
+      /** a grant seen from the grantee's side. in the grantee's scope, so their shares are one range read. **/
+      // @abi table shares
+      struct share_record {
+         uint64_t id;
+         account_name owner;
+         uint64_t folder;
+         uint8_t rights;
+
+         auto primary_key() const { return id; }
+         uint128_t get_target() const { return grant_target(owner, folder); }
+
+         EOSLIB_SERIALIZE_LAYOUT(share_record, inspace::share_layout, (id)(owner)(folder)(rights))
+      };
+
+      /** the union of the rights granted on a folder. only folders with grants have one. **/
+      // @abi table aclsummary
+      struct acl_summary_record {
+         uint64_t folder;
+         uint8_t rights;
+         uint64_t grant_count;
+
+         auto primary_key() const { return folder; }
+
+         EOSLIB_SERIALIZE_LAYOUT(acl_summary_record, inspace::acl_summary_layout, (folder)(rights)(grant_count))
+      };
+
+      /**
+       * rows a user holds and their packed size, per table. folder and file bytes include their
+       * nameindex entries. the bookkeeping rows of clones, shared versions, grants, shares and
+       * inboxes are not counted, and neither are the progress rows of the migrations.
+       */
+      // @abi table usage
+      struct usage_record {
+         uint64_t folders = 0;
+         uint64_t folder_bytes = 0;
+         uint64_t files = 0;
+         uint64_t file_bytes = 0;
+         uint64_t versions = 0;
+         uint64_t version_bytes = 0;
+         uint64_t keys = 0;
+         uint64_t key_bytes = 0;
+         uint64_t enckeys = 0;
+         uint64_t enckey_bytes = 0;
+
+         uint64_t& count(int kind) {
+            switch (kind) {
+               case usage_folders: return folders;
+               case usage_files: return files;
+               case usage_versions: return versions;
+               case usage_keys: return keys;
+               default: return enckeys;
+            }
+         }
+
+         uint64_t& bytes(int kind) {
+            switch (kind) {
+               case usage_folders: return folder_bytes;
+               case usage_files: return file_bytes;
+               case usage_versions: return version_bytes;
+               case usage_keys: return key_bytes;
+               default: return enckey_bytes;
+            }
+         }
+
+         uint64_t total_bytes() const {
+            return folder_bytes + file_bytes + version_bytes + key_bytes + enckey_bytes;
+         }
+
+         EOSLIB_CHECK_LAYOUT(usage_record, inspace::usage_layout, (folders)(folder_bytes)(files)(file_bytes)(versions)(version_bytes)(keys)(key_bytes)(enckeys)(enckey_bytes))
+         EOSLIB_SERIALIZE_FIXED(usage_record, (folders)(folder_bytes)(files)(file_bytes)(versions)(version_bytes)(keys)(key_bytes)(enckeys)(enckey_bytes))
+      };
+
+      /** how far recountusage got, and what it counted so far. one per user scope. **/
+      // @abi table usagerecount
+      struct usage_recount_record {
+         uint64_t phase; /** RECOUNT_FOLDERS to RECOUNT_NAMES, or RECOUNT_DONE **/
+         uint64_t next;  /** the row id to go on from **/
+         usage_record usage;
+
+         EOSLIB_SERIALIZE_FIXED(usage_recount_record, (phase)(next)(usage))
+      };
+
+      static_assert(inspace::usage_recount_layout::fixed_size == sizeof(usage_recount_record), "usage_recount_layout does not match usage_recount_record");
+
+      /** quotas (0 means no limit) and who pays for RAM. set by the contract account. **/
+      // @abi table config
+      struct config_record {
+         uint64_t max_folders = 0;
+         uint64_t max_files = 0;
+         uint64_t max_versions = 0;
+         uint64_t max_keys = 0;
+         uint64_t max_enckeys = 0;
+         uint64_t max_bytes = 0;
+         bool user_pays_ram = false;
+
+         EOSLIB_SERIALIZE_LAYOUT(config_record, inspace::config_layout, (max_folders)(max_files)(max_versions)(max_keys)(max_enckeys)(max_bytes)(user_pays_ram))
+      };
+
+      /** a word of a folder or file name, for search by word or prefix. in the user's scope. **/
+      // @abi table nameindex
+      struct name_token_record {
+         uint64_t id;
+         uint64_t token; /** see name_tokens() **/
+         uint8_t kind;   /** NAME_FOLDER or NAME_FILE **/
+         uint64_t target;
+
+         auto primary_key() const { return id; }
+         uint64_t get_token() const { return token; }
+         uint128_t get_target() const { return name_target(kind, target); }
+
+         EOSLIB_SERIALIZE_LAYOUT(name_token_record, inspace::name_token_layout, (id)(token)(kind)(target))
+      };
+
+      /** the clone in progress. one per user scope. **/
+      // @abi table clonejob
+      struct clone_job_record {
+         uint64_t source;
+         uint64_t target;
+         uint64_t id_offset;
+         uint64_t copied; /** folders and files copied so far **/
+
+         EOSLIB_CHECK_LAYOUT(clone_job_record, inspace::clone_job_layout, (source)(target)(id_offset)(copied))
+         EOSLIB_SERIALIZE_FIXED(clone_job_record, (source)(target)(id_offset)(copied))
+      };
+
+      /** a folder whose children are still to be copied, oldest first **/
+      // @abi table clonequeue
+      struct clone_queue_record {
+         uint64_t id;
+         uint64_t source;
+         uint64_t target;
+         uint64_t last_child; /** the last child copied in this phase, or NULL_ID **/
+         uint8_t phase;       /** CLONE_PHASE_FOLDERS, then CLONE_PHASE_FILES **/
+
+         auto primary_key() const { return id; }
+
+         EOSLIB_SERIALIZE_LAYOUT(clone_queue_record, inspace::clone_queue_layout, (id)(source)(target)(last_child)(phase))
+      };
+
+      /** clones that share a version, besides the file it belongs to **/
+      // @abi table versionrefs
+      struct version_ref_record {
+         uint64_t version;
+         uint64_t refs;
+
+         auto primary_key() const { return version; }
+
+         EOSLIB_CHECK_LAYOUT(version_ref_record, inspace::version_ref_layout, (version)(refs))
+         EOSLIB_SERIALIZE_FIXED(version_ref_record, (version)(refs))
+      };
+
+      /** the version a cloned file shares with its source **/
+      // @abi table sharedvers
+      struct shared_version_record {
+         uint64_t file;
+         uint64_t version;
+
+         auto primary_key() const { return file; }
+
+         EOSLIB_CHECK_LAYOUT(shared_version_record, inspace::shared_version_layout, (file)(version))
+         EOSLIB_SERIALIZE_FIXED(shared_version_record, (file)(version))
+      };
+
+      /** how far migratekeys got. one per user scope. **/
+      // @abi table keymigration
+      struct key_migration_record {
+         uint64_t phase; /** MIGRATE_VERSIONS, MIGRATE_KEYS, MIGRATE_ENC_KEYS or MIGRATE_DONE **/
+         uint64_t next;  /** the version, key or encrypted key id to go on from **/
+
+         EOSLIB_CHECK_LAYOUT(key_migration_record, inspace::key_migration_layout, (phase)(next))
+         EOSLIB_SERIALIZE_FIXED(key_migration_record, (phase)(next))
+      };
+
+      /** likes of deleted versions that are still to be erased **/
+      // @abi table likepurges
+      struct like_purge_record {
+         uint64_t id;
+         account_name liked;
+         uint64_t version;
+
+         auto primary_key() const { return id; }
+
+         EOSLIB_CHECK_LAYOUT(like_purge_record, inspace::like_purge_layout, (id)(liked)(version))
+         EOSLIB_SERIALIZE_FIXED(like_purge_record, (id)(liked)(version))
+      };
+
+      /** how far reindexnames got. one per user scope. **/
+      // @abi table namereindex
+      struct name_reindex_record {
+         uint64_t phase; /** NAME_REINDEX_FOLDERS, NAME_REINDEX_FILES or NAME_REINDEX_DONE **/
+         uint64_t next;  /** the folder or file id to go on from **/
+
+         EOSLIB_CHECK_LAYOUT(name_reindex_record, inspace::name_reindex_layout, (phase)(next))
+         EOSLIB_SERIALIZE_FIXED(name_reindex_record, (phase)(next))
+      };
 
-         EOSLIB_SERIALIZE(post_record, (id)(account)(is_folder)(subject)(caption)(date))
+      /** how far reindexlikes got **/
+      // @abi table likereindex
+      struct like_reindex_record {
+         uint64_t next_id = 0;
+         uint64_t done = 0;
+
+         EOSLIB_CHECK_LAYOUT(like_reindex_record, inspace::like_reindex_layout, (next_id)(done))
+         EOSLIB_SERIALIZE_FIXED(like_reindex_record, (next_id)(done))
+      };
+
+      /** how far reindexposts got **/
+      // @abi table postreindex
+      struct post_reindex_record {
+         uint64_t next_id = 0;
+         uint64_t done = 0;
+
+         EOSLIB_CHECK_LAYOUT(post_reindex_record, inspace::post_reindex_layout, (next_id)(done))
+         EOSLIB_SERIALIZE_FIXED(post_reindex_record, (next_id)(done))
+      };
+
+      /** where auditlikes continues **/
+      // @abi table likeaudit
+      struct like_audit_record {
+         uint64_t next_id = 0;
+
+         EOSLIB_CHECK_LAYOUT(like_audit_record, inspace::like_audit_layout, (next_id))
+         EOSLIB_SERIALIZE_FIXED(like_audit_record, (next_id))
       };
 
       /*
@@ -588,12 +2542,63 @@ class filespace : public contract {
                           version_record,
                           indexed_by<N(by_file), /** secondary index on file **/
                                      const_mem_fun<version_record, uint64_t, &version_record::get_file>
+                                     >,
+                          indexed_by<N(by_key), /** secondary index on key **/
+                                     const_mem_fun<version_record, uint64_t, &version_record::get_key>
                                      >
                          > version_table_type;
 
-      typedef multi_index<N(likes),
-                          like_record
-                         > like_table_type;
+      typedef inspace::like_table_type like_table_type;
+
+      typedef multi_index<N(nameindex),
+                          name_token_record,
+                          indexed_by<N(by_token), /** secondary index on token, for word and prefix lookups **/
+                                     const_mem_fun<name_token_record, uint64_t, &name_token_record::get_token>
+                                    >,
+                          indexed_by<N(by_target), /** secondary index on kind and folder or file id **/
+                                     const_mem_fun<name_token_record, uint128_t, &name_token_record::get_target>
+                                    >
+                         > name_index_table_type;
+
+      /** one per user scope **/
+      typedef singleton<N(keymigration),
+                        key_migration_record
+                       > key_migration_singleton_type;
+
+      /** one per user scope **/
+      typedef singleton<N(namereindex),
+                        name_reindex_record
+                       > name_reindex_singleton_type;
+
+      /** one per user scope **/
+      typedef singleton<N(clonejob),
+                        clone_job_record
+                       > clone_job_singleton_type;
+
+      typedef multi_index<N(clonequeue),
+                          clone_queue_record
+                         > clone_queue_table_type;
+
+      typedef multi_index<N(versionrefs),
+                          version_ref_record
+                         > version_ref_table_type;
+
+      typedef multi_index<N(sharedvers),
+                          shared_version_record
+                         > shared_version_table_type;
+
+      /** in the contract's own scope, like the likes **/
+      typedef multi_index<N(likepurges),
+                          like_purge_record
+                         > like_purge_table_type;
+
+      typedef singleton<N(likeaudit),
+                        like_audit_record
+                       > like_audit_singleton_type;
+
+      typedef singleton<N(likereindex),
+                        like_reindex_record
+                       > like_reindex_singleton_type;
 
       typedef multi_index<N(profiles),
                           profile_record
@@ -604,12 +2609,163 @@ class filespace : public contract {
                          > key_table_type;
 
       typedef multi_index<N(enckeys),
-                          enc_key_record
+                          enc_key_record,
+                          indexed_by<N(by_key), /** secondary index on key **/
+                                     const_mem_fun<enc_key_record, uint64_t, &enc_key_record::get_key>
+                                    >,
+                          indexed_by<N(by_pubkey), /** secondary index on a hash of the recipient's public key **/
+                                     const_mem_fun<enc_key_record, uint64_t, &enc_key_record::get_public_key_hash>
+                                    >
                          > enc_key_table_type;
 
      typedef multi_index<N(posts),
-                         post_record
+                         post_record,
+                         indexed_by<N(by_account), /** secondary index on author **/
+                                    const_mem_fun<post_record, account_name, &post_record::get_account>
+                                   >
                         > post_table_type;
+
+      /** in the contract's own scope, like the posts **/
+      typedef singleton<N(postreindex),
+                        post_reindex_record
+                       > post_reindex_singleton_type;
+
+      typedef multi_index<N(inbox),
+                          inbox_record
+                         > inbox_table_type;
+
+      typedef multi_index<N(pullauthors),
+                          pull_author_record
+                         > pull_author_table_type;
+
+      typedef multi_index<N(folderhashes),
+                          folder_hash_record
+                         > folder_hash_table_type;
+
+      /** one per user scope **/
+      typedef singleton<N(roothash),
+                        root_hash_record
+                       > root_hash_singleton_type;
+
+      typedef multi_index<N(grants),
+                          grant_record,
+                          indexed_by<N(by_target), /** secondary index on folder and grantee **/
+                                     const_mem_fun<grant_record, uint128_t, &grant_record::get_target>
+                                    >
+                         > grant_table_type;
+
+      typedef multi_index<N(shares),
+                          share_record,
+                          indexed_by<N(by_target), /** secondary index on owner and folder **/
+                                     const_mem_fun<share_record, uint128_t, &share_record::get_target>
+                                    >
+                         > share_table_type;
+
+      typedef multi_index<N(aclsummary),
+                          acl_summary_record
+                         > acl_summary_table_type;
+
+      /** one per user scope **/
+      typedef singleton<N(usage),
+                        usage_record
+                       > usage_singleton_type;
+
+      /** one per user scope **/
+      typedef singleton<N(usagerecount),
+                        usage_recount_record
+                       > usage_recount_singleton_type;
+
+      /** in the contract's own scope **/
+      typedef singleton<N(config),
+                        config_record
+                       > config_singleton_type;
+
+      /*
+
+      usage accounting
+
+      */
+      /** the acting user's usage, loaded on first change and written back once by save_usage() **/
+      usage_record usage;
+      account_name usage_user = 0;
+      bool usage_changed = false;
+      bool usage_grew = false;
+
+      config_record config;
+      bool config_loaded = false;
+
+      /** set when a grantee acts in someone else's space **/
+      account_name acting_grantee = 0;
+
+      const config_record& get_config() {
+         if (!config_loaded) {
+            config = config_singleton_type(_self, _self).get_or_default(config_record{});
+            config_loaded = true;
+         }
+         return config;
+      }
+
+      /** who pays for rows added or changed in user's space: the user, or a grantee acting there **/
+      account_name ram_payer(account_name user) {
+         if (!get_config().user_pays_ram) {
+            return _self;
+         }
+         return acting_grantee != 0 ? acting_grantee : user;
+      }
+
+      /** records rows added (count > 0) or removed (count < 0) and the change in their packed size **/
+      void add_usage(account_name user, usage_kind kind, int64_t count, int64_t bytes) {
+         if (usage_user != user) {
+            eosio_assert(usage_user == 0, "Usage of another user is pending!");
+            usage_recount_singleton_type usage_recount(_self, user);
+            eosio_assert(!usage_recount.exists() || usage_recount.get().phase == RECOUNT_DONE, "Usage is being recounted, run recountusage!");
+            usage = usage_singleton_type(_self, user).get_or_default(usage_record{});
+            usage_user = user;
+         }
+
+         /** rows added before usage was tracked are not counted, so never go below zero **/
+         uint64_t& row_count = usage.count(kind);
+         uint64_t& row_bytes = usage.bytes(kind);
+         row_count = (count < 0 && row_count < uint64_t(-count)) ? 0 : row_count + count;
+         row_bytes = (bytes < 0 && row_bytes < uint64_t(-bytes)) ? 0 : row_bytes + bytes;
+
+         usage_changed = true;
+         usage_grew = usage_grew || count > 0 || bytes > 0;
+      }
+
+      /** adds up to budget rows of a table to a recount, from state.next on. returns true once the table is done. **/
+      template<typename Table>
+      bool recount_rows(Table& table, usage_kind kind, usage_recount_record& state, uint32_t& budget) {
+         auto iterator = table.lower_bound(state.next);
+         for (; budget > 0 && iterator != table.end(); ++iterator, --budget) {
+            state.usage.count(kind) += 1;
+            state.usage.bytes(kind) += pack_size(*iterator);
+            state.next = (*iterator).primary_key() + 1;
+         }
+         return iterator == table.end();
+      }
+
+      /** checks the quotas if usage grew, unless told not to, and writes the usage row back **/
+      void save_usage(bool enforce_quotas = true) {
+         if (!usage_changed) {
+            return;
+         }
+
+         if (usage_grew && enforce_quotas) {
+            const config_record& limits = get_config();
+            eosio_assert(limits.max_folders == 0 || usage.folders <= limits.max_folders, "Folder quota exceeded!");
+            eosio_assert(limits.max_files == 0 || usage.files <= limits.max_files, "File quota exceeded!");
+            eosio_assert(limits.max_versions == 0 || usage.versions <= limits.max_versions, "Version quota exceeded!");
+            eosio_assert(limits.max_keys == 0 || usage.keys <= limits.max_keys, "Key quota exceeded!");
+            eosio_assert(limits.max_enckeys == 0 || usage.enckeys <= limits.max_enckeys, "Enc key quota exceeded!");
+            eosio_assert(limits.max_bytes == 0 || usage.total_bytes() <= limits.max_bytes, "Storage quota exceeded!");
+         }
+
+         usage_singleton_type(_self, usage_user).set(usage, ram_payer(usage_user));
+         usage_user = 0;
+         usage_changed = false;
+         usage_grew = false;
+      }
 };
 
-EOSIO_ABI(filespace, (addfolder)(renamefolder)(movefolder)(addfile)(renamefile)(movefile)(setcurrentve)(addversion)(deletefolder)(deletefile)(addlike)(deletelike)(setprofile)(addkey)(addenckey)(addpost))
+EOSIO_ABI(filespace, (addfolder)(renamefolder)(movefolder)(addfile)(renamefile)(movefile)(setcurrentve)(addversion)(rekeyvers)(importtree)(deletefolder)(deletefile)(addlike)(deletelike)(setprofile)(addkey)(deletekey)(migratekeys)(reindexnames)(recountusage)(addenckey)(addenckeys)(delenckeys)(addpost)(reindexposts)(setconfig)(addfolderas)(addfileas)(addversionas)(deletefileas)(grant)(revoke)(purgelikes)(auditlikes)(reindexlikes)(clonefolder)(clonestep)(cancelclone))
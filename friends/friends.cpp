@@ -1,9 +1,30 @@
 #include <eosiolib/eosio.hpp>
 #include <eosiolib/print.hpp>
+#include <eosiolib/singleton.hpp>
+#include <eosiolib/transaction.hpp>
+
+#include "../common/checked_layout.hpp"
+#include "../common/fixed_layout.hpp"
+#include "../common/friendship.hpp"
 
 using namespace eosio;
 using namespace std;
 
+/** seconds a friend request stays pending before it expires **/
+static const uint64_t REQUEST_LIFETIME = 30 * 24 * 60 * 60;
+
+/** pending requests one account can have outstanding **/
+static const uint64_t MAX_PENDING_REQUESTS = 100;
+
+/** seconds between scheduled prunereqs runs, and expired requests erased per run **/
+static const uint32_t PRUNE_INTERVAL = 60 * 60;
+static const uint32_t PRUNE_BATCH = 100;
+
+/** phases of reindexreqs **/
+static const uint64_t REINDEX_REQUESTS = 0;
+static const uint64_t REINDEX_COUNTS = 1;
+static const uint64_t REINDEX_DONE = 2;
+
 class friends : public contract {
    using contract::contract;
 
@@ -12,7 +33,8 @@ class friends : public contract {
       friends(account_name self) :
          contract(self),
          request_table(_self, _self),
-         friendship_table(_self, _self) {}
+         friendship_table(_self, _self),
+         request_count_table(_self, _self) {}
 
       // @abi action
       void addrequest(account_name user, account_name to) {
@@ -23,7 +45,7 @@ class friends : public contract {
          /** make sure a friendship doesn't already exist **/
          auto friendships_by_account1 = friendship_table.get_index<N(by_account1)>();
          bool exists = false;
-         for (auto iterator = friendships_by_account1.find(user); iterator != friendships_by_account1.end(); ++iterator) {
+         for (auto iterator = friendships_by_account1.lower_bound(user); iterator != friendships_by_account1.end() && (*iterator).account1 == user; ++iterator) {
             if ((*iterator).account2 == to) {
                exists = true;
                break;
@@ -32,7 +54,7 @@ class friends : public contract {
          eosio_assert(!exists, "Friendship exists!");
 
          exists = false;
-         for (auto iterator = friendships_by_account1.find(to); iterator != friendships_by_account1.end(); ++iterator) {
+         for (auto iterator = friendships_by_account1.lower_bound(to); iterator != friendships_by_account1.end() && (*iterator).account1 == to; ++iterator) {
             if ((*iterator).account2 == user) {
                exists = true;
                break;
@@ -40,33 +62,39 @@ class friends : public contract {
          }
          eosio_assert(!exists, "Friendship exists!");
 
-         /**  make sure request doesn't already exist **/
+         const uint64_t current_time = now();
+
+         /**  make sure request doesn't already exist. an expired one is replaced. **/
          auto requests_by_from = request_table.get_index<N(by_from)>();
-         exists = false;
-         for (auto iterator = requests_by_from.find(user); iterator != requests_by_from.end(); ++iterator) {
+         for (auto iterator = requests_by_from.lower_bound(user); iterator != requests_by_from.end() && (*iterator).from == user; ++iterator) {
             if ((*iterator).to == to) {
-               exists = true;
+               eosio_assert((*iterator).get_expiry() <= current_time, "Friend request exists!");
+               remove_request_count(user);
+               requests_by_from.erase(iterator);
                break;
             }
          }
-         eosio_assert(!exists, "Friend request exists!");
 
          /**  check for opposite request **/
-         exists = false;
-         auto iterator = requests_by_from.find(to);
-         for (; iterator != requests_by_from.end(); ++iterator) {
-            if ((*iterator).to == user) {
-               exists = true;
-               break;
+         for (auto iterator = requests_by_from.lower_bound(to); iterator != requests_by_from.end() && (*iterator).from == to; ++iterator) {
+            if ((*iterator).to != user) {
+               continue;
             }
-         }
-         if (exists) {
+
+            const bool expired = (*iterator).get_expiry() <= current_time;
+
             /** delete it **/
+            remove_request_count(to);
             requests_by_from.erase(iterator);
 
+            if (expired) {
+               /** too late to accept. send a new request instead. **/
+               break;
+            }
+
             /** add friendship **/
             friendship_table.emplace(_self, [&](auto& friendship_record) {
-               friendship_record.id = request_table.available_primary_key();
+               friendship_record.id = friendship_table.available_primary_key();
                friendship_record.account1 = user;
                friendship_record.account2 = to;
             });
@@ -76,15 +104,254 @@ class friends : public contract {
          }
 
          /** add the record **/
+         add_request_count(user, 1);
          request_table.emplace(_self, [&](auto& request_record) {
             request_record.id = request_table.available_primary_key();
             request_record.from = user;
             request_record.to = to;
+            request_record.created = current_time;
          });
       }
 
+      /**
+       * sends requests to many accounts at once, e.g. imported contacts. accounts that are
+       * already friends or already have a pending request from user are skipped, and pending
+       * requests from the other side are accepted.
+       */
+      // @abi action
+      void addrequests(account_name user, vector<account_name> targets) {
+         require_auth(user);
+
+         sort(targets.begin(), targets.end());
+         targets.erase(unique(targets.begin(), targets.end()), targets.end());
+         eosio_assert(!binary_search(targets.begin(), targets.end(), user), "Can't befriend yourself!");
+
+         const uint64_t current_time = now();
+
+         /** user's friends, and the requests in each direction, each sorted by the other account **/
+         vector<account_name> friend_accounts;
+         auto friendships_by_account1 = friendship_table.get_index<N(by_account1)>();
+         for (auto iterator = friendships_by_account1.lower_bound(user); iterator != friendships_by_account1.end() && (*iterator).account1 == user; ++iterator) {
+            friend_accounts.push_back((*iterator).account2);
+         }
+         auto friendships_by_account2 = friendship_table.get_index<N(by_account2)>();
+         for (auto iterator = friendships_by_account2.lower_bound(user); iterator != friendships_by_account2.end() && (*iterator).account2 == user; ++iterator) {
+            friend_accounts.push_back((*iterator).account1);
+         }
+         sort(friend_accounts.begin(), friend_accounts.end());
+
+         vector<request_ref> sent;
+         auto requests_by_from = request_table.get_index<N(by_from)>();
+         for (auto iterator = requests_by_from.lower_bound(user); iterator != requests_by_from.end() && (*iterator).from == user; ++iterator) {
+            sent.push_back(request_ref{(*iterator).to, (*iterator).id, (*iterator).get_expiry() <= current_time});
+         }
+         sort(sent.begin(), sent.end());
+
+         vector<request_ref> received;
+         auto requests_by_to = request_table.get_index<N(by_to)>();
+         for (auto iterator = requests_by_to.lower_bound(user); iterator != requests_by_to.end() && (*iterator).to == user; ++iterator) {
+            received.push_back(request_ref{(*iterator).from, (*iterator).id, (*iterator).get_expiry() <= current_time});
+         }
+         sort(received.begin(), received.end());
+
+         /** one merged walk over the targets and the three sorted lists **/
+         auto friend_iterator = friend_accounts.begin();
+         auto sent_iterator = sent.begin();
+         auto received_iterator = received.begin();
+         int64_t pending_change = 0;
+         for (account_name to : targets) {
+            while (friend_iterator != friend_accounts.end() && *friend_iterator < to) ++friend_iterator;
+            while (sent_iterator != sent.end() && sent_iterator->account < to) ++sent_iterator;
+            while (received_iterator != received.end() && received_iterator->account < to) ++received_iterator;
+
+            if (friend_iterator != friend_accounts.end() && *friend_iterator == to) {
+               continue;
+            }
+
+            if (sent_iterator != sent.end() && sent_iterator->account == to) {
+               if (!sent_iterator->expired) {
+                  continue;
+               }
+               /** an expired request is replaced below **/
+               request_table.erase(request_table.get(sent_iterator->id));
+               --pending_change;
+            }
+
+            if (received_iterator != received.end() && received_iterator->account == to) {
+               request_table.erase(request_table.get(received_iterator->id));
+               remove_request_count(to);
+
+               if (!received_iterator->expired) {
+                  friendship_table.emplace(_self, [&](auto& friendship_record) {
+                     friendship_record.id = friendship_table.available_primary_key();
+                     friendship_record.account1 = user;
+                     friendship_record.account2 = to;
+                  });
+                  continue;
+               }
+            }
+
+            eosio_assert(is_account(to), "Account does not exist!");
+            request_table.emplace(_self, [&](auto& request_record) {
+               request_record.id = request_table.available_primary_key();
+               request_record.from = user;
+               request_record.to = to;
+               request_record.created = current_time;
+            });
+            ++pending_change;
+         }
+
+         /** the sender's count changes once for the whole batch **/
+         if (pending_change > 0) {
+            add_request_count(user, pending_change);
+         } else if (pending_change < 0) {
+            remove_request_count(user, -pending_change);
+         }
+      }
+
+      /** erases up to max_count expired requests, oldest first, and schedules the next run **/
+      // @abi action
+      void prunereqs(uint32_t max_count) {
+         require_auth(_self);
+
+         const uint64_t current_time = now();
+
+         auto requests_by_expiry = request_table.get_index<N(by_expiry)>();
+         auto iterator = requests_by_expiry.begin();
+         for (uint32_t count = 0; count < max_count && iterator != requests_by_expiry.end() && (*iterator).get_expiry() <= current_time; ++count) {
+            remove_request_count((*iterator).from);
+            iterator = requests_by_expiry.erase(iterator);
+         }
+
+         /** come back soon if expired requests are left, otherwise after the interval **/
+         const bool backlog = iterator != requests_by_expiry.end() && (*iterator).get_expiry() <= current_time;
+
+         transaction out;
+         out.actions.emplace_back(
+            permission_level{_self, N(active)},
+            _self,
+            N(prunereqs),
+            std::make_tuple(PRUNE_BATCH));
+         out.delay_sec = backlog ? 1 : PRUNE_INTERVAL;
+         out.send(N(prunereqs), _self, true); // replaces the pending run, so only one is ever scheduled
+      }
+
+      /**
+       * brings requests written before they expired up to date, up to max_count rows per call.
+       * first every request is added back with its creation time set to now, which gives it
+       * the by_expiry entry it is missing, then each sender's pending requests are counted
+       * into reqcounts. repeat until it asserts that the requests are reindexed.
+       */
+      // @abi action
+      void reindexreqs(uint32_t max_count) {
+         require_auth(_self);
+
+         request_reindex_singleton_type request_reindex(_self, _self);
+         request_reindex_record state = request_reindex.get_or_default(request_reindex_record{REINDEX_REQUESTS, 0});
+         eosio_assert(state.phase != REINDEX_DONE, "Requests are reindexed!");
+
+         uint32_t count = 0;
+
+         if (state.phase == REINDEX_REQUESTS) {
+            auto iterator = request_table.lower_bound(state.next);
+            for (; count < max_count && iterator != request_table.end(); ++count) {
+               const request_record request = *iterator;
+               iterator = request_table.erase(iterator);
+               request_table.emplace(_self, [&](auto& request_record) {
+                  request_record = request;
+               });
+               state.next = request.id + 1;
+            }
+
+            if (iterator == request_table.end()) {
+               state = request_reindex_record{REINDEX_COUNTS, 0};
+            }
+         }
+
+         if (state.phase == REINDEX_COUNTS) {
+            auto requests_by_from = request_table.get_index<N(by_from)>();
+            auto iterator = requests_by_from.lower_bound(state.next);
+            while (count < max_count && iterator != requests_by_from.end()) {
+               /** a sender is counted in one go, so max_count can be exceeded by the requests of one sender **/
+               const account_name from = (*iterator).from;
+               uint64_t pending = 0;
+               for (; iterator != requests_by_from.end() && (*iterator).from == from; ++iterator) {
+                  ++pending;
+               }
+               set_request_count(from, pending);
+               state.next = from + 1;
+               count += pending;
+            }
+
+            if (iterator == requests_by_from.end()) {
+               state = request_reindex_record{REINDEX_DONE, 0};
+            }
+         }
+
+         request_reindex.set(state, _self);
+      }
+
    private:
 
+      /** a pending request seen from one side: the other account, and whether it has expired **/
+      struct request_ref {
+         account_name account;
+         uint64_t id;
+         bool expired;
+
+         bool operator<(const request_ref& other) const { return account < other.account; }
+      };
+
+      /** counts new pending requests against their sender's cap **/
+      void add_request_count(account_name from, uint64_t count) {
+         auto iterator = request_count_table.find(from);
+         if (iterator == request_count_table.end()) {
+            eosio_assert(count <= MAX_PENDING_REQUESTS, "Too many pending friend requests!");
+            request_count_table.emplace(_self, [&](auto& request_count_record) {
+               request_count_record.from = from;
+               request_count_record.count = count;
+            });
+            return;
+         }
+
+         eosio_assert((*iterator).count + count <= MAX_PENDING_REQUESTS, "Too many pending friend requests!");
+         request_count_table.modify(iterator, 0, [&](auto& request_count_record) {
+            request_count_record.count += count;
+         });
+      }
+
+      /** sets a sender's count, e.g. to the requests they sent before counting began. not capped. **/
+      void set_request_count(account_name from, uint64_t count) {
+         auto iterator = request_count_table.find(from);
+         if (iterator == request_count_table.end()) {
+            request_count_table.emplace(_self, [&](auto& request_count_record) {
+               request_count_record.from = from;
+               request_count_record.count = count;
+            });
+         } else {
+            request_count_table.modify(iterator, 0, [&](auto& request_count_record) {
+               request_count_record.count = count;
+            });
+         }
+      }
+
+      /** releases pending requests from their sender's count **/
+      void remove_request_count(account_name from, uint64_t count = 1) {
+         auto iterator = request_count_table.find(from);
+         if (iterator == request_count_table.end()) {
+            /** requests from before counting began **/
+            return;
+         }
+
+         if ((*iterator).count <= count) {
+            request_count_table.erase(iterator);
+         } else {
+            request_count_table.modify(iterator, 0, [&](auto& request_count_record) {
+               request_count_record.count -= count;
+            });
+         }
+      }
+
       /*
 
       data structures for tables
@@ -95,25 +362,55 @@ class friends : public contract {
          uint64_t id;
          account_name from;
          account_name to;
+         uint64_t created; /** seconds since epoch **/
 
          auto primary_key() const { return id; }
          account_name get_from() const { return from; }
          account_name get_to() const { return to; }
+         uint64_t get_expiry() const { return created + REQUEST_LIFETIME; }
+
+         EOSLIB_CHECK_LAYOUT(request_record, inspace::request_layout, (id)(from)(to)(created))
 
-         EOSLIB_SERIALIZE(request_record, (id)(from)(to))
+         template<typename DataStream>
+         friend DataStream& operator<<(DataStream& ds, const request_record& t) {
+            return ds << t.id << t.from << t.to << t.created;
+         }
+
+         /** rows written before requests expired end after to. they count as created now until reindexreqs writes that down. **/
+         template<typename DataStream>
+         friend DataStream& operator>>(DataStream& ds, request_record& t) {
+            ds >> t.id >> t.from >> t.to;
+            t.created = now();
+            if (ds.remaining() >= sizeof(t.created)) {
+               ds >> t.created;
+            }
+            return ds;
+         }
       };
 
-      // @abi table friendships
-      struct friendship_rec { // 'friendship_record' is longer than 13 characters
-         uint64_t id;
-         account_name account1;
-         account_name account2;
+      /** friendships are read by filespace too. see common/friendship.hpp. **/
+      typedef inspace::friendship_rec friendship_rec;
 
-         auto primary_key() const { return id; }
-         account_name get_account1() const { return account1; }
-         account_name get_account2() const { return account2; }
+      /** pending requests per sender **/
+      // @abi table reqcounts
+      struct request_count_record {
+         account_name from;
+         uint64_t count;
 
-         EOSLIB_SERIALIZE(friendship_rec, (id)(account1)(account2))
+         auto primary_key() const { return from; }
+
+         EOSLIB_CHECK_LAYOUT(request_count_record, inspace::request_count_layout, (from)(count))
+         EOSLIB_SERIALIZE_FIXED(request_count_record, (from)(count))
+      };
+
+      /** how far reindexreqs got **/
+      // @abi table reqreindex
+      struct request_reindex_record {
+         uint64_t phase; /** REINDEX_REQUESTS, REINDEX_COUNTS or REINDEX_DONE **/
+         uint64_t next;  /** the request id or sender to go on from **/
+
+         EOSLIB_CHECK_LAYOUT(request_reindex_record, inspace::request_reindex_layout, (phase)(next))
+         EOSLIB_SERIALIZE_FIXED(request_reindex_record, (phase)(next))
       };
 
       /*
@@ -128,22 +425,26 @@ class friends : public contract {
                                     >,
                           indexed_by<N(by_to), /** secondary index on to **/
                                      const_mem_fun<request_record, account_name, &request_record::get_to>
+                                    >,
+                          indexed_by<N(by_expiry), /** secondary index on expiry time **/
+                                     const_mem_fun<request_record, uint64_t, &request_record::get_expiry>
                                     >
                          > request_table_type;
 
-      typedef multi_index<N(friendships),
-                          friendship_rec,
-                          indexed_by<N(by_account1),
-                                     const_mem_fun<friendship_rec, account_name, &friendship_rec::get_account1>
-                                    >,
-                          indexed_by<N(by_account2),
-                                     const_mem_fun<friendship_rec, account_name, &friendship_rec::get_account2>
-                                    >
-                          > friendship_table_type;
+      typedef inspace::friendship_table_type friendship_table_type;
+
+      typedef multi_index<N(reqcounts),
+                          request_count_record
+                         > request_count_table_type;
+
+      typedef singleton<N(reqreindex),
+                        request_reindex_record
+                       > request_reindex_singleton_type;
 
       request_table_type request_table;
       friendship_table_type friendship_table;
+      request_count_table_type request_count_table;
 
 };
 
-EOSIO_ABI(friends, (addrequest))
+EOSIO_ABI(friends, (addrequest)(addrequests)(prunereqs)(reindexreqs))
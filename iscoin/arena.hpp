@@ -0,0 +1,196 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+// bytes reserved for temporaries of one action
+#ifndef ISCOIN_ARENA_SIZE
+#define ISCOIN_ARENA_SIZE (32 * 1024)
+#endif
+
+namespace eosio {
+
+   // A bump allocator for containers that live no longer than the action.
+   // The contract's memory is discarded after every action, so nothing is ever
+   // handed back except the most recent block (which lets a growing vector
+   // reuse its tail). Requests that do not fit fall back to operator new.
+   namespace arena {
+      static char     buffer[ISCOIN_ARENA_SIZE] __attribute__((aligned(16)));
+      static size_t   used = 0;
+      static size_t   last = 0; // offset of the most recent block
+
+      inline void* allocate( size_t size, size_t align ) {
+         const size_t start = (used + align - 1) & ~(align - 1);
+         if( start + size > sizeof(buffer) ) {
+            return ::operator new( size );
+         }
+         last = start;
+         used = start + size;
+         return buffer + start;
+      }
+
+      inline void deallocate( void* p, size_t size ) {
+         char* c = static_cast<char*>(p);
+         if( c < buffer || c >= buffer + sizeof(buffer) ) {
+            ::operator delete( p );
+            return;
+         }
+         if( c == buffer + last && last + size == used ) {
+            used = last;
+         }
+      }
+   }
+
+   template<typename T>
+   struct arena_allocator {
+      typedef T value_type;
+
+      arena_allocator() {}
+      template<typename U> arena_allocator( const arena_allocator<U>& ) {}
+
+      T* allocate( size_t n ) {
+         return static_cast<T*>(arena::allocate( n * sizeof(T), alignof(T) ));
+      }
+      void deallocate( T* p, size_t n ) {
+         arena::deallocate( p, n * sizeof(T) );
+      }
+
+      template<typename U> bool operator==( const arena_allocator<U>& )const { return true; }
+      template<typename U> bool operator!=( const arena_allocator<U>& )const { return false; }
+   };
+
+   template<typename T>
+   using arena_vector = std::vector<T, arena_allocator<T>>;
+
+   // A map kept as a sorted vector in the arena. Built in bulk with
+   // push_back() followed by merge(), which sorts once and folds duplicate
+   // keys together instead of paying a lookup per insert.
+   template<typename Key, typename Value>
+   class flat_map {
+      public:
+         typedef std::pair<Key, Value>                        value_type;
+         typedef typename arena_vector<value_type>::iterator       iterator;
+         typedef typename arena_vector<value_type>::const_iterator const_iterator;
+
+         void reserve( size_t n ) { items.reserve( n ); }
+         size_t size()const { return items.size(); }
+
+         void push_back( const Key& key, const Value& value ) {
+            items.emplace_back( key, value );
+         }
+
+         // sorts by key and combines the values of equal keys with op
+         template<typename Op>
+         void merge( Op op ) {
+            std::sort( items.begin(), items.end(), []( const value_type& a, const value_type& b ) {
+               return a.first < b.first;
+            });
+            size_t out = 0;
+            for( size_t i = 0; i < items.size(); ++i ) {
+               if( out > 0 && items[out - 1].first == items[i].first ) {
+                  items[out - 1].second = op( items[out - 1].second, items[i].second );
+               } else {
+                  items[out++] = items[i];
+               }
+            }
+            items.resize( out );
+         }
+
+         // only valid after merge()
+         const_iterator find( const Key& key )const {
+            auto it = std::lower_bound( items.begin(), items.end(), key, []( const value_type& a, const Key& k ) {
+               return a.first < k;
+            });
+            return (it != items.end() && it->first == key) ? it : items.end();
+         }
+
+         iterator begin() { return items.begin(); }
+         iterator end() { return items.end(); }
+         const_iterator begin()const { return items.begin(); }
+         const_iterator end()const { return items.end(); }
+
+      private:
+         arena_vector<value_type> items;
+   };
+
+   // An open-addressing hash map in the arena, for caches that are looked up
+   // far more often than they grow. Hash returns a uint64_t for a Key; keys
+   // are compared with ==. Pointers returned by find() and insert() stay
+   // valid until the next insert.
+   template<typename Key, typename Value, typename Hash>
+   class flat_hash_map {
+      public:
+         Value* find( const Key& key ) {
+            if( slots.empty() ) {
+               return nullptr;
+            }
+            for( size_t i = Hash()( key ) & (slots.size() - 1); slots[i].used; i = (i + 1) & (slots.size() - 1) ) {
+               if( slots[i].key == key ) {
+                  return &slots[i].value;
+               }
+            }
+            return nullptr;
+         }
+
+         // key must not be present yet
+         Value& insert( const Key& key, const Value& value ) {
+            if( (count + 1) * 4 > slots.size() * 3 ) {
+               grow();
+            }
+            ++count;
+            return place( key, value );
+         }
+
+         template<typename F>
+         void for_each( F f ) {
+            for( auto& s : slots ) {
+               if( s.used ) {
+                  f( s.key, s.value );
+               }
+            }
+         }
+
+         size_t size()const { return count; }
+
+      private:
+         struct slot {
+            bool  used = false;
+            Key   key;
+            Value value;
+         };
+
+         Value& place( const Key& key, const Value& value ) {
+            size_t i = Hash()( key ) & (slots.size() - 1);
+            while( slots[i].used ) {
+               i = (i + 1) & (slots.size() - 1);
+            }
+            slots[i].used = true;
+            slots[i].key = key;
+            slots[i].value = value;
+            return slots[i].value;
+         }
+
+         void grow() {
+            arena_vector<slot> old;
+            old.swap( slots );
+            slots.resize( old.empty() ? 16 : old.size() * 2 );
+            for( const auto& s : old ) {
+               if( s.used ) {
+                  place( s.key, s.value );
+               }
+            }
+         }
+
+         arena_vector<slot> slots;
+         size_t             count = 0;
+   };
+
+} /// namespace eosio
@@ -9,7 +9,6 @@
 #include <eosiolib/symbol.hpp>
 #include <eosiolib/transaction.hpp>
 #include <string>
-#include <vector>
 
 namespace eosio {
 
@@ -59,6 +58,7 @@ void token::issue( account_name to, asset quantity, string memo )
     });
 
     add_balance( st.issuer, quantity, st.issuer );
+    flush_rows();
 
     if( to != st.issuer ) {
        SEND_INLINE_ACTION( *this, transfer, {st.issuer,N(active)}, {st.issuer, to, quantity, memo} );
@@ -73,9 +73,7 @@ void token::transfer( account_name from,
     eosio_assert( from != to, "cannot transfer to self" );
     require_auth( from );
     eosio_assert( is_account( to ), "to account does not exist");
-    auto sym = quantity.symbol.name();
-    stats statstable( _self, sym );
-    const auto& st = statstable.get( sym );
+    const auto& st = cached_stats( quantity.symbol.name() );
 
     // no transaction fee for issuer
     bool is_issuer = false;
@@ -94,6 +92,43 @@ void token::transfer( account_name from,
 
     sub_balance( from, quantity, is_issuer );
     add_balance( to, quantity, from );
+    flush_rows();
+}
+
+// one debit, fee and distribution for several transfers from the same account.
+// this is an action of its own, not a series of transfers: the sender and
+// every recipient are notified of one transferbatch action, and no transfer
+// action is ever sent. code that only handles transfer won't see these
+// payments.
+void token::transferbatch( account_name                 from,
+                           const vector<transfer_item>& transfers )
+{
+    require_auth( from );
+    eosio_assert( !transfers.empty(), "no transfers" );
+
+    const auto& st = cached_stats( transfers.front().quantity.symbol.name() );
+
+    require_recipient( from );
+
+    asset total( 0, st.supply.symbol );
+    for( const auto& t : transfers ) {
+       eosio_assert( from != t.to, "cannot transfer to self" );
+       eosio_assert( is_account( t.to ), "to account does not exist");
+       eosio_assert( t.quantity.is_valid(), "invalid quantity" );
+       eosio_assert( t.quantity.amount > 0, "must transfer positive quantity" );
+       eosio_assert( t.quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
+       eosio_assert( t.memo.size() <= 256, "memo has more than 256 bytes" );
+
+       total += t.quantity;
+       require_recipient( t.to );
+    }
+
+    // no transaction fee for issuer
+    sub_balance( from, total, from == st.issuer );
+    for( const auto& t : transfers ) {
+       add_balance( t.to, t.quantity, from );
+    }
+    flush_rows();
 }
 
 void token::addstake( account_name staker,
@@ -124,6 +159,9 @@ void token::addstake( account_name staker,
 
    int64_t weight = get_stake_weight(duration) * quantity.amount;
 
+   // before the modify below, which needs the row's byweight entry
+   stake_totals totals = load_stake_totals( quantity.symbol );
+
    stake_stats stake_stats_table( _self, sym );
    const auto staker_stake_stats = stake_stats_table.find( staker );
    if( staker_stake_stats == stake_stats_table.end() ) {
@@ -138,12 +176,23 @@ void token::addstake( account_name staker,
          s.stake_weight += weight;
       });
    }
+
+   totals.total_stake += quantity;
+   totals.total_weight += weight;
+   stake_totals_singleton( _self, sym ).set( totals, _self );
 }
 
 void token::updatestakes( string symbolname ) {
    eosio::symbol_type symbol(eosio::string_to_symbol(4, symbolname.c_str()));
+
+   // gives rows from before byweight their index entries, so they can be modified
+   load_stake_totals( symbol );
+
    stake_stats stake_stats_table( _self, symbol.name() );
 
+   // the totals are rebuilt from the sweep, which visits every staker
+   stake_totals totals{ asset( 0, symbol ), 0 };
+
    // iterate through stake stats
    // (all stakes will have an entry because addstake adds one)
    auto iterator = stake_stats_table.begin();
@@ -191,10 +240,14 @@ void token::updatestakes( string symbolname ) {
             s.total_stake = total_stake;
             s.stake_weight = stake_weight;
          });
+         totals.total_stake += total_stake;
+         totals.total_weight += stake_weight;
          ++iterator;
       }
    }
 
+   stake_totals_singleton( _self, symbol.name() ).set( totals, _self );
+
    // schedule a transaction to do it again
    eosio::transaction out;
    out.actions.emplace_back(
@@ -202,31 +255,29 @@ void token::updatestakes( string symbolname ) {
       _self,
       N(updatestakes),
       std::make_tuple(symbolname));
-   out.delay_sec = update_interval;
+   out.delay_sec = policy::update_interval;
    out.send(_self + now(), _self); // needs a unique sender id so append current time
 }
 
 void token::sub_balance( account_name owner, asset value, bool no_fee ) {
-   accounts from_acnts( _self, owner );
-
-    eosio::symbol_type symbol = value.symbol;
+   eosio::symbol_type symbol = value.symbol;
 
-   const auto& from = from_acnts.get( symbol.name(), "no balance object found" );
+   auto& from = cached_account( owner, symbol );
+   eosio_assert( from.live, "no balance object found" );
 
    const asset stake = get_stake(owner, symbol );
 
    const int64_t value_amount = value.amount;
-   const int64_t transaction_fee_amount = no_fee ? 0 : (int64_t)(value_amount * transaction_fee);
+   const int64_t transaction_fee_amount = no_fee ? 0 : policy::apply_bps( value_amount, policy::transaction_fee_bps );
    const int64_t total_amount = value_amount + transaction_fee_amount;
 
    eosio_assert( from.balance.amount - stake.amount >= total_amount, "overdrawn unstaked balance" );
 
-   if( from.balance.amount == total_amount ) {
-      from_acnts.erase( from );
-   } else {
-      from_acnts.modify( from, owner, [&]( auto& a ) {
-          a.balance.amount -= total_amount;
-      });
+   from.balance.amount -= total_amount;
+   from.changed = true;
+   from.debited = true;
+   if( from.balance.amount == 0 ) {
+      from.live = false;
    }
 
    if (no_fee) {
@@ -234,14 +285,14 @@ void token::sub_balance( account_name owner, asset value, bool no_fee ) {
    }
 
    int64_t transaction_fee_remaining = transaction_fee_amount;
-   const int64_t transaction_fee_stakers_amount = (int64_t)(transaction_fee_to_stakers * transaction_fee_amount);
+   const int64_t transaction_fee_stakers_amount = policy::apply_bps( transaction_fee_amount, policy::transaction_fee_to_stakers_bps );
    asset transaction_fee_stakers_asset;
    transaction_fee_stakers_asset.symbol = symbol;
    transaction_fee_stakers_asset.amount = transaction_fee_stakers_amount;
 
    transaction_fee_remaining -= distribute(transaction_fee_stakers_asset);
 
-   const int64_t transaction_fee_likes_amount = (int64_t)(transaction_fee_to_likes * transaction_fee_amount);
+   const int64_t transaction_fee_likes_amount = policy::apply_bps( transaction_fee_amount, policy::transaction_fee_to_likes_bps );
    asset transaction_fee_likes_asset;
    transaction_fee_likes_asset.symbol = symbol;
    transaction_fee_likes_asset.amount = transaction_fee_likes_amount;
@@ -259,88 +310,182 @@ void token::sub_balance( account_name owner, asset value, bool no_fee ) {
 
 void token::add_balance( account_name owner, asset value, account_name ram_payer )
 {
-   accounts to_acnts( _self, owner );
-   auto to = to_acnts.find( value.symbol.name() );
-   if( to == to_acnts.end() ) {
-      to_acnts.emplace( ram_payer, [&]( auto& a ){
-        a.balance = value;
-      });
-   } else {
-      to_acnts.modify( to, 0, [&]( auto& a ) {
-        a.balance += value;
-      });
+   auto& to = cached_account( owner, value.symbol );
+   if( !to.live ) {
+      to.live = true;
+      if( !to.in_table && to.ram_payer == 0 ) {
+         to.ram_payer = ram_payer;
+      }
    }
+   to.balance += value;
+   to.changed = true;
 }
 
-asset token::get_stake( account_name staker, eosio::symbol_type sym )const
+// reads a balance row into the cache, or returns the cached copy.
+// the row is only written back by flush_rows().
+token::cached_balance& token::cached_account( account_name owner, eosio::symbol_type sym )const
 {
-   stake_stats stake_stats_table( _self, sym );
-   const auto staker_stake_stats = stake_stats_table.find( staker );
-   if( staker_stake_stats == stake_stats_table.end() ) {
-      // no enty, so no stakes
-      asset ret;
-      ret.symbol = sym;
-      ret.amount = 0;
-      return ret;
+   const row_key key{ owner, sym.name() };
+   cached_balance* cached = balance_cache.find( key );
+   if( cached != nullptr ) {
+      return *cached;
+   }
+
+   cached_balance row;
+   accounts acnts( _self, owner );
+   const auto it = acnts.find( sym.name() );
+   if( it != acnts.end() ) {
+      row.balance = it->balance;
+      row.in_table = true;
+      row.live = true;
    } else {
-      return (*staker_stake_stats).total_stake;
+      row.balance = asset( 0, sym );
    }
+   return balance_cache.insert( key, row );
 }
 
-int64_t token::get_stake_weight( account_name staker, eosio::symbol_type sym )const
+// stakestats is scoped by the symbol name, as addstake writes it. this lookup
+// used to pass the whole symbol, precision included, and always missed, so
+// staked tokens could still be transferred or staked again.
+const token::cached_stake& token::cached_stake_stat( account_name staker, eosio::symbol_type sym )const
 {
-   stake_stats stake_stats_table( _self, sym );
-   const auto staker_stake_stats = stake_stats_table.find( staker );
-   if( staker_stake_stats == stake_stats_table.end() ) {
-      // no enty, so no stakes
-      return (int64_t)0;
+   const row_key key{ sym.name(), staker };
+   const cached_stake* cached = stake_cache.find( key );
+   if( cached != nullptr ) {
+      return *cached;
+   }
+
+   cached_stake row;
+   stake_stats stake_stats_table( _self, sym.name() );
+   const auto it = stake_stats_table.find( staker );
+   if( it != stake_stats_table.end() ) {
+      row.exists = true;
+      row.total_stake = it->total_stake;
+      row.stake_weight = it->stake_weight;
    } else {
-      return (*staker_stake_stats).stake_weight;
+      // no entry, so no stakes
+      row.total_stake = asset( 0, sym );
    }
+   return stake_cache.insert( key, row );
 }
 
-asset token::get_unstaked_balance( account_name owner, eosio::symbol_type sym )const
+const token::currency_stats& token::cached_stats( symbol_name sym )const
 {
-   const asset balance = get_balance(owner, sym.name());
-   const asset stake = get_stake(owner, sym);
-   return asset(balance.amount - stake.amount, sym);
+   if( !stat_cached || stat_cache.supply.symbol.name() != sym ) {
+      stats statstable( _self, sym );
+      stat_cache = statstable.get( sym );
+      stat_cached = true;
+   }
+   return stat_cache;
 }
 
-// distributes the quantity amongst stakers by stake weight.
-// returns the actual amount distruted.
-int64_t token::distribute( asset quantity )
+// writes every changed balance back with one update per row. a row debited
+// to zero is erased unless it was credited again in the same action.
+void token::flush_rows()
 {
-   stake_stats stake_stats_table( _self, quantity.symbol.name() );
+   balance_cache.for_each( [&]( const row_key& key, cached_balance& row ) {
+      if( !row.changed ) {
+         return;
+      }
+      row.changed = false;
+
+      accounts acnts( _self, key.scope );
+      if( row.in_table ) {
+         const auto& existing = acnts.get( key.primary, "no balance object found" );
+         if( !row.live ) {
+            acnts.erase( existing );
+            row.in_table = false;
+         } else if( row.debited || existing.balance != row.balance ) {
+            acnts.modify( existing, row.debited ? key.scope : 0, [&]( auto& a ) {
+               a.balance = row.balance;
+            });
+         }
+      } else if( row.live ) {
+         acnts.emplace( row.ram_payer, [&]( auto& a ) {
+            a.balance = row.balance;
+         });
+         row.in_table = true;
+      }
+   });
+}
 
-   std::vector<account_name>  stakers;
-   std::vector<int64_t>       weights;
-   int64_t                    total_weight = 0;
+asset token::get_stake( account_name staker, eosio::symbol_type sym )const
+{
+   return cached_stake_stat( staker, sym ).total_stake;
+}
 
-   // iterate through stake stats
-   auto iterator = stake_stats_table.begin();
-   while ( iterator != stake_stats_table.end() ) {
+int64_t token::get_stake_weight( account_name staker, eosio::symbol_type sym )const
+{
+   return cached_stake_stat( staker, sym ).stake_weight;
+}
 
-      const auto& st = (*iterator);
+asset token::get_unstaked_balance( account_name owner, eosio::symbol_type sym )const
+{
+   const auto& balance = cached_account( owner, sym );
+   eosio_assert( balance.live, "no balance object found" );
+   const asset stake = get_stake(owner, sym);
+   return asset(balance.balance.amount - stake.amount, sym);
+}
 
-      stakers.push_back(st.staker);
-      weights.push_back(st.stake_weight);
-      total_weight += st.stake_weight;
+// the staking totals of a symbol. stakestats written before the totals were
+// kept has no staketotals row and no byweight entries. the first action that
+// needs the totals then adds every row back, which indexes it, and sums them.
+token::stake_totals token::load_stake_totals( eosio::symbol_type sym )
+{
+   stake_totals_singleton totals_singleton( _self, sym.name() );
+   if( totals_singleton.exists() ) {
+      return totals_singleton.get();
+   }
 
-      ++iterator;
+   stake_totals totals{ asset( 0, sym ), 0 };
+   stake_stats stake_stats_table( _self, sym.name() );
+   auto iterator = stake_stats_table.begin();
+   while( iterator != stake_stats_table.end() ) {
+      const stake_stat st = *iterator;
+      iterator = stake_stats_table.erase( iterator );
+      stake_stats_table.emplace( _self, [&]( auto& s ) {
+         s.staker = st.staker;
+         s.total_stake = st.total_stake;
+         s.stake_weight = st.stake_weight;
+      });
+      totals.total_stake += st.total_stake;
+      totals.total_weight += st.stake_weight;
    }
 
+   totals_singleton.set( totals, _self );
+   return totals;
+}
+
+// distributes the quantity amongst stakers by stake weight.
+// returns the actual amount distruted.
+int64_t token::distribute( asset quantity )
+{
+   const symbol_name sym = quantity.symbol.name();
+
+   // the total is kept by addstake and updatestakes, so one pass pays everyone
+   const int64_t total_weight = load_stake_totals( quantity.symbol ).total_weight;
    if (total_weight == 0) {
       return 0;
    }
 
-   int64_t amount_distributed = 0;
+   stake_stats stake_stats_table( _self, sym );
 
-   for(size_t i = 0; i < stakers.size(); i++) {
-      account_name staker = stakers[i];
+   int64_t amount_distributed = 0;
 
-      int64_t staker_weight = weights[i];
+   // iterate through stake stats
+   for( const auto& st : stake_stats_table ) {
+
+      // distribute_likes looks up the same rows
+      const row_key key{ sym, st.staker };
+      if( stake_cache.find( key ) == nullptr ) {
+         cached_stake row;
+         row.exists = true;
+         row.total_stake = st.total_stake;
+         row.stake_weight = st.stake_weight;
+         stake_cache.insert( key, row );
+      }
 
-      float proportion = (float)staker_weight / total_weight;
+      float proportion = (float)st.stake_weight / total_weight;
 
       int64_t amount_for_staker = (int64_t)(quantity.amount  * proportion);
 
@@ -348,7 +493,7 @@ int64_t token::distribute( asset quantity )
       amount_asset.symbol = quantity.symbol;
       amount_asset.amount = amount_for_staker;
 
-      add_balance( staker, amount_asset, _self);
+      add_balance( st.staker, amount_asset, _self);
       amount_distributed += amount_for_staker;
    }
 
@@ -359,34 +504,29 @@ int64_t token::distribute( asset quantity )
 // returns the actual amount distruted.
 int64_t token::distribute_likes( asset quantity )
 {
-   like_table_type like_table(N(filespace), N(filespace));
-   stake_stats stake_stats_table( _self, quantity.symbol.name() );
+   // only liker and liked are needed, so read just those from filespace's rows
+   inspace::like_view likes( N(filespace), N(filespace) );
 
-   std::map<account_name, int64_t> liked_weights;
+   // one entry per like, folded into one entry per liked account below
+   flat_map<account_name, int64_t> liked_weights;
    int64_t total_weight = 0;
 
-   // iterate through likes
-   for (auto iterator = like_table.begin(); iterator != like_table.end(); ++iterator) {
+   liked_weights.reserve( 256 );
 
-      const account_name liked = (*iterator).liked;
+   // iterate through likes
+   for (auto iterator = likes.begin(); iterator != likes.end(); ++iterator) {
 
       // get stake weight of liker
-      const auto staker_stake_stats = stake_stats_table.find( (*iterator).liker );
+      const auto& liker_stake = cached_stake_stat( iterator.get<inspace::like_liker>(), quantity.symbol );
 
-      if (staker_stake_stats == stake_stats_table.end()) {
+      if (!liker_stake.exists) {
          // no stake
-         liked_weights[liked] = 0;
          continue;
       }
 
-      const int64_t likerWeight = (*staker_stake_stats).stake_weight;
-
-      if (liked_weights.count(liked) == 0) {
-         liked_weights[liked] = likerWeight;
-      } else {
-         liked_weights[liked] += likerWeight;
-      }
+      const int64_t likerWeight = liker_stake.stake_weight;
 
+      liked_weights.push_back( iterator.get<inspace::like_liked>(), likerWeight );
       total_weight += likerWeight;
    }
 
@@ -394,12 +534,14 @@ int64_t token::distribute_likes( asset quantity )
       return 0;
    }
 
+   liked_weights.merge( []( int64_t a, int64_t b ) { return a + b; } );
+
    int64_t amount_distributed = 0;
 
-   for (std::map<account_name, int64_t>::iterator iterator = liked_weights.begin(); iterator != liked_weights.end(); ++iterator) {
+   for (const auto& liked_weight : liked_weights) {
 
-      account_name liked = iterator->first;
-      int64_t weight = iterator->second;
+      account_name liked = liked_weight.first;
+      int64_t weight = liked_weight.second;
 
       float proportion = (float)weight / total_weight;
 
@@ -418,4 +560,4 @@ int64_t token::distribute_likes( asset quantity )
 
 } /// namespace eosio
 
-EOSIO_ABI( eosio::token, (create)(issue)(transfer)(addstake)(updatestakes) )
+EOSIO_ABI( eosio::token, (create)(issue)(transfer)(transferbatch)(addstake)(updatestakes) )
@@ -7,12 +7,14 @@
 #include <eosiolib/eosio.hpp>
 #include <eosiolib/asset.hpp>
 #include <eosiolib/time.hpp>
+#include <eosiolib/singleton.hpp>
 
-// time in seconds
-const uint32_t ONE_MINUTE = 60;
-const uint32_t ONE_HOUR = ONE_MINUTE * 60;
-const uint32_t ONE_DAY = ONE_HOUR * 24;
-const uint32_t ONE_YEAR = ONE_DAY * 365;
+#include "../common/checked_layout.hpp"
+#include "../common/fixed_layout.hpp"
+#include "../common/likes.hpp"
+#include "../common/table_layouts.hpp"
+#include "arena.hpp"
+#include "policy.hpp"
 
 namespace eosiosystem {
    class system_contract;
@@ -21,9 +23,18 @@ namespace eosiosystem {
 namespace eosio {
 
    using std::string;
+   using std::vector;
 
    class token : public contract {
       public:
+         struct transfer_item {
+            account_name  to;
+            asset         quantity;
+            string        memo;
+
+            EOSLIB_SERIALIZE( transfer_item, (to)(quantity)(memo) )
+         };
+
          token( account_name self ):contract(self){}
 
          void create( account_name issuer,
@@ -36,6 +47,9 @@ namespace eosio {
                         asset        quantity,
                         string       memo );
 
+         void transferbatch( account_name                 from,
+                             const vector<transfer_item>& transfers );
+
          void addstake( account_name staker,
                         asset        quantity,
                         uint32_t     duration );
@@ -53,6 +67,9 @@ namespace eosio {
             asset    balance;
 
             uint64_t primary_key()const { return balance.symbol.name(); }
+
+            EOSLIB_CHECK_LAYOUT( account, inspace::account_layout, (balance) )
+            EOSLIB_SERIALIZE_FIXED( account, (balance) )
          };
 
          struct currency_stats {
@@ -61,6 +78,9 @@ namespace eosio {
             account_name            issuer;
 
             uint64_t primary_key()const { return supply.symbol.name(); }
+
+            EOSLIB_CHECK_LAYOUT( currency_stats, inspace::currency_stats_layout, (supply)(max_supply)(issuer) )
+            EOSLIB_SERIALIZE_FIXED( currency_stats, (supply)(max_supply)(issuer) )
          };
 
          struct stake {
@@ -70,6 +90,9 @@ namespace eosio {
             uint32_t                duration;
 
             uint64_t primary_key()const { return id; }
+
+            EOSLIB_CHECK_LAYOUT( stake, inspace::stake_layout, (id)(quantity)(start)(duration) )
+            EOSLIB_SERIALIZE_FIXED( stake, (id)(quantity)(start)(duration) )
          };
 
          struct stake_stat {
@@ -78,12 +101,74 @@ namespace eosio {
             int64_t        stake_weight;
 
             uint64_t primary_key()const { return staker; }
+            // weights are never negative, so this orders stakers by weight
+            uint64_t by_weight()const { return static_cast<uint64_t>(stake_weight); }
+
+            EOSLIB_CHECK_LAYOUT( stake_stat, inspace::stake_stat_layout, (staker)(total_stake)(stake_weight) )
+            EOSLIB_SERIALIZE_FIXED( stake_stat, (staker)(total_stake)(stake_weight) )
+         };
+
+         // sums over the stakestats scope of the same symbol
+         struct stake_totals {
+            asset          total_stake;
+            int64_t        total_weight;
+
+            EOSLIB_CHECK_LAYOUT( stake_totals, inspace::stake_totals_layout, (total_stake)(total_weight) )
+            EOSLIB_SERIALIZE_FIXED( stake_totals, (total_stake)(total_weight) )
          };
 
          typedef eosio::multi_index<N(accounts), account> accounts;
          typedef eosio::multi_index<N(stat), currency_stats> stats;
          typedef eosio::multi_index<N(stakes), stake> stakes;
-         typedef eosio::multi_index<N(stakestats), stake_stat> stake_stats;
+         typedef eosio::multi_index<N(stakestats), stake_stat,
+                                    indexed_by<N(byweight),
+                                               const_mem_fun<stake_stat, uint64_t, &stake_stat::by_weight>
+                                              >
+                                   > stake_stats;
+         typedef eosio::singleton<N(staketotals), stake_totals> stake_totals_singleton;
+
+         // rows read during one action, keyed by (scope, primary key).
+         // balances are changed in memory and written back by flush_rows(),
+         // so each row is read and written at most once per action.
+         struct row_key {
+            uint64_t scope;
+            uint64_t primary;
+
+            bool operator==( const row_key& other )const {
+               return scope == other.scope && primary == other.primary;
+            }
+         };
+
+         struct row_key_hash {
+            uint64_t operator()( const row_key& k )const {
+               return (k.scope ^ (k.primary * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL >> 32;
+            }
+         };
+
+         struct cached_balance {
+            asset          balance;
+            bool           in_table = false;  // row existed when it was read
+            bool           live = false;      // row should exist after the action
+            bool           changed = false;
+            bool           debited = false;   // owner pays for the row, as when it is debited
+            account_name   ram_payer = 0;     // payer if the row has to be created
+         };
+
+         struct cached_stake {
+            bool           exists = false;
+            asset          total_stake;
+            int64_t        stake_weight = 0;
+         };
+
+         cached_balance& cached_account( account_name owner, eosio::symbol_type sym )const;
+         const cached_stake& cached_stake_stat( account_name staker, eosio::symbol_type sym )const;
+         const currency_stats& cached_stats( symbol_name sym )const;
+         void flush_rows();
+
+         mutable flat_hash_map<row_key, cached_balance, row_key_hash>  balance_cache;
+         mutable flat_hash_map<row_key, cached_stake, row_key_hash>    stake_cache;
+         mutable currency_stats                                        stat_cache;
+         mutable bool                                                  stat_cached = false;
 
          void sub_balance( account_name owner, asset value,  bool no_fee=false );
          void add_balance( account_name owner, asset value, account_name ram_payer );
@@ -91,52 +176,12 @@ namespace eosio {
          asset get_stake( account_name owner, eosio::symbol_type sym )const;
          int64_t get_stake_weight( account_name owner, eosio::symbol_type sym )const;
          asset get_unstaked_balance( account_name owner, eosio::symbol_type sym )const;
+         stake_totals load_stake_totals( eosio::symbol_type sym );
          int64_t distribute( asset quantity );
          int64_t distribute_likes( asset quantity );
 
-         const float transaction_fee = 0.01; // 1%
-
-         const float transaction_fee_to_stakers = 0.7f; // 70%
-         const float transaction_fee_to_likes = 0.15f; // 15%
-         // inSpace gets the rest (15%)
+         // fees and stake tiers are set by the policy in policy.hpp
          const account_name inspace_account = N(inspace);
-
-         static const size_t stake_count = 5;
-         // short durations for testing
-         // TODO: change to days, not minutes
-         const uint32_t stake_durations[stake_count] = {
-            0,
-            30 * ONE_MINUTE,
-            90 * ONE_MINUTE,
-            180 * ONE_MINUTE,
-            360  * ONE_MINUTE
-         };
-
-         const int64_t stake_weights[stake_count] = {
-            0,
-            5,
-            6,
-            7,
-            10
-         };
-
-         const uint32_t update_interval = ONE_MINUTE;
-
-         // this is from the filespace contract
-         // TODO; factor into a common hpp file
-         struct like_record {
-            uint64_t id;
-            account_name liker;
-            account_name liked;
-            uint64_t version;
-
-            auto primary_key() const { return id; }
-
-            EOSLIB_SERIALIZE(like_record, (id)(liker)(liked)(version))
-         };
-         typedef multi_index<N(likes),
-                             like_record
-                            > like_table_type;
       public:
          struct transfer_args {
             account_name  from;
@@ -162,11 +207,7 @@ namespace eosio {
 
    int64_t token::get_stake_weight( uint32_t stake_duration )const
    {
-      size_t i = 0;
-      while ((i+1) < stake_count && stake_duration >= stake_durations[i+1]) {
-         i = i+1;
-      }
-      return stake_weights[i];
+      return policy::stake_weight( stake_duration );
    }
 
 
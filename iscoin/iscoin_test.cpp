@@ -0,0 +1,8 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+
+// the same contract with the short stake durations of test_policy
+#define ISCOIN_TEST_POLICY
+#include "iscoin.cpp"
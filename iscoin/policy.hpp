@@ -0,0 +1,103 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// time in seconds
+const uint32_t ONE_MINUTE = 60;
+const uint32_t ONE_HOUR = ONE_MINUTE * 60;
+const uint32_t ONE_DAY = ONE_HOUR * 24;
+const uint32_t ONE_YEAR = ONE_DAY * 365;
+
+namespace eosio {
+
+   // Fee and staking parameters, fixed at compile time. Stake durations are
+   // counted in TimeUnit seconds so the test build can use minutes where the
+   // production build uses days; updatestakes runs every UpdateInterval.
+   template<uint32_t TimeUnit, uint32_t UpdateInterval>
+   struct iscoin_policy {
+      // fees are in basis points
+      static constexpr int64_t bps_denominator = 10000;
+
+      static constexpr int64_t transaction_fee_bps = 100;            // 1% of the transfer
+      static constexpr int64_t transaction_fee_to_stakers_bps = 7000; // 70% of the fee
+      static constexpr int64_t transaction_fee_to_likes_bps = 1500;   // 15% of the fee
+      // inSpace gets the rest (15%)
+
+      static constexpr size_t stake_count = 5;
+
+      // minimum duration for each tier, ascending
+      static constexpr uint32_t stake_durations[stake_count] = {
+         0,
+         30 * TimeUnit,
+         90 * TimeUnit,
+         180 * TimeUnit,
+         360 * TimeUnit
+      };
+
+      static constexpr int64_t stake_weights[stake_count] = {
+         0,
+         5,
+         6,
+         7,
+         10
+      };
+
+      static constexpr uint32_t update_interval = UpdateInterval;
+
+      // floor(amount * bps / 10000) without overflowing for large amounts
+      static constexpr int64_t apply_bps( int64_t amount, int64_t bps ) {
+         return (amount / bps_denominator) * bps + (amount % bps_denominator) * bps / bps_denominator;
+      }
+
+      // the tier is the number of thresholds reached, so the lookup is a
+      // fixed number of comparisons with no data-dependent branches
+      static constexpr int64_t stake_weight( uint32_t duration ) {
+         size_t tier = 0;
+         for( size_t i = 1; i < stake_count; ++i ) {
+            tier += duration >= stake_durations[i];
+         }
+         return stake_weights[tier];
+      }
+
+      static constexpr bool durations_ascending() {
+         for( size_t i = 1; i < stake_count; ++i ) {
+            if( stake_durations[i] <= stake_durations[i - 1] ) {
+               return false;
+            }
+         }
+         return true;
+      }
+
+      static_assert( transaction_fee_bps >= 0 && transaction_fee_bps <= bps_denominator, "transaction fee must be between 0 and 100%" );
+      static_assert( transaction_fee_to_stakers_bps >= 0 && transaction_fee_to_likes_bps >= 0, "fee shares must not be negative" );
+      static_assert( transaction_fee_to_stakers_bps + transaction_fee_to_likes_bps <= bps_denominator, "fee shares exceed the fee" );
+      static_assert( stake_durations[0] == 0, "the first tier must cover every duration" );
+   };
+
+   template<uint32_t TimeUnit, uint32_t UpdateInterval>
+   constexpr uint32_t iscoin_policy<TimeUnit, UpdateInterval>::stake_durations[];
+
+   template<uint32_t TimeUnit, uint32_t UpdateInterval>
+   constexpr int64_t iscoin_policy<TimeUnit, UpdateInterval>::stake_weights[];
+
+   // short durations, for testing on a local node
+   typedef iscoin_policy<ONE_MINUTE, ONE_MINUTE> test_policy;
+
+   typedef iscoin_policy<ONE_DAY, ONE_HOUR> production_policy;
+
+   static_assert( test_policy::durations_ascending(), "stake durations must be ascending" );
+   static_assert( production_policy::durations_ascending(), "stake durations must be ascending" );
+
+   // iscoin_test.cpp defines ISCOIN_TEST_POLICY to build the test contract
+#ifdef ISCOIN_TEST_POLICY
+   typedef test_policy policy;
+#else
+   typedef production_policy policy;
+#endif
+
+} /// namespace eosio
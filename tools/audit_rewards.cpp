@@ -0,0 +1,759 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Recomputes the fee payouts of iscoin transfers offline and compares them
+ *  with what the chain did.
+ *
+ *  usage: audit_rewards [-j threads] [-t transfers_per_range] [-c token_contract] [-a after_dump] [-n top] <dump> <transfer log>
+ *
+ *  The dump (see tables.hpp) is the state before the first transfer of the
+ *  log. The stat, stakestats and staketotals tables of the token contract
+ *  (iscoin by default) and the likes of filespace are read from it. Stakes
+ *  and likes are taken to be unchanged for the whole log, so a log should not
+ *  span an addstake, an updatestakes that expires a stake, or likes added or
+ *  deleted; audit such windows separately, each from its own dump.
+ *
+ *  The log has one transfer or transferbatch per line:
+ *
+ *     <time> <symbol> <from> <to>:<amount>[,<to>:<amount>...] [<account>:<delta>[,...]]
+ *
+ *  e.g. "1530000000 ISC alice bob:10000". Amounts are in the token's
+ *  smallest unit. The optional last field lists the balance changes the
+ *  chain made for the action, e.g. taken from state history; an account
+ *  left out did not change. Lines starting with # are skipped.
+ *
+ *  Each transfer's fee is split the way sub_balance, distribute and
+ *  distribute_likes split it, with the same integer and float arithmetic
+ *  and the fee parameters of iscoin/policy.hpp. The transfers of each symbol
+ *  are cut into ranges of consecutive times, and the ranges are audited in
+ *  parallel. For every symbol it reports the first transfer whose changes
+ *  differ from the logged ones, and the drift per account: the observed
+ *  change minus the expected one. The observed change is the balance in
+ *  after_dump minus the balance in dump when -a is given, or else the sum
+ *  of the logged changes. Other actions in the window, such as issue, show
+ *  up as drift when -a is used.
+ *
+ *  Build it the way the contracts are built, without -ffast-math, so float
+ *  proportions round as they do in wasm.
+ */
+#include "tables.hpp"
+#include "../iscoin/policy.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+   using namespace inspace::tools;
+   typedef eosio::policy policy;
+
+   const size_t DEFAULT_TRANSFERS_PER_RANGE = 10000;
+   const size_t DEFAULT_TOP_COUNT = 20;
+
+   /** iscoin reads the likes from this contract and scope, and pays the rest of each fee to inspace **/
+   const uint64_t LIKES_CODE = string_to_name("filespace");
+   const uint64_t INSPACE_ACCOUNT = string_to_name("inspace");
+
+   const uint64_t ACCOUNTS_TABLE = string_to_name("accounts");
+   const uint64_t STAT_TABLE = string_to_name("stat");
+   const uint64_t STAKE_STATS_TABLE = string_to_name("stakestats");
+   const uint64_t STAKE_TOTALS_TABLE = string_to_name("staketotals");
+   const uint64_t LIKES_TABLE = string_to_name("likes");
+
+   /*
+
+   symbols
+
+   */
+
+   /** the name of a symbol code, as eosio::symbol_type::name() gives it **/
+   bool symbol_name(const string& code, uint64_t& name) {
+      if (code.empty() || code.size() > 7) {
+         return false;
+      }
+      name = 0;
+      for (size_t i = 0; i < code.size(); ++i) {
+         if (code[i] < 'A' || code[i] > 'Z') {
+            return false;
+         }
+         name |= uint64_t(uint8_t(code[i])) << (8 * i);
+      }
+      return true;
+   }
+
+   string symbol_code(uint64_t name) {
+      string code;
+      for (; name != 0; name >>= 8) {
+         code += char(name & 0xff);
+      }
+      return code;
+   }
+
+   bool parse_account(const string& text, uint64_t& name) {
+      if (text.empty() || text.size() > 12) {
+         return false;
+      }
+      name = string_to_name(text.c_str());
+      return name_to_string(name) == text;
+   }
+
+   /*
+
+   state from dumps
+
+   */
+   struct balance {
+      uint64_t symbol;
+      uint64_t owner;
+      int64_t amount;
+
+      bool operator<(const balance& other) const { return std::tie(symbol, owner) < std::tie(other.symbol, other.owner); }
+   };
+
+   struct stake_stat {
+      uint64_t symbol;
+      uint64_t staker;
+      int64_t weight;
+
+      bool operator<(const stake_stat& other) const { return std::tie(symbol, staker) < std::tie(other.symbol, other.staker); }
+   };
+
+   struct symbol_state {
+      uint64_t symbol;
+      bool has_stats = false;
+      uint64_t issuer = 0;
+      bool has_totals = false;
+      int64_t total_weight = 0;
+   };
+
+   struct snapshot {
+      vector<balance> balances;
+      vector<stake_stat> stake_stats;
+      vector<symbol_state> symbols;
+      vector<std::pair<uint64_t, uint64_t>> likes; /** liker, liked **/
+
+      symbol_state& state_for(uint64_t symbol) {
+         for (symbol_state& state : symbols) {
+            if (state.symbol == symbol) {
+               return state;
+            }
+         }
+         symbols.push_back(symbol_state{symbol});
+         return symbols.back();
+      }
+   };
+
+   bool bad_row(const string& path, const row& value) {
+      fprintf(stderr, "%s: can't decode a %s row in scope %s\n", path.c_str(),
+              name_to_string(value.table).c_str(), name_to_string(value.scope).c_str());
+      return false;
+   }
+
+   /** reads the rows the payouts depend on. with balances_only, just the balances. **/
+   bool load_snapshot(const string& path, uint64_t token_code, bool balances_only, snapshot& state) {
+      dump_reader dump(path);
+      if (!dump.is_open()) {
+         fprintf(stderr, "can't read %s\n", path.c_str());
+         return false;
+      }
+
+      row next;
+      while (dump.next(next)) {
+         const char* data = next.data.data();
+         const size_t size = next.data.size();
+
+         if (next.code == token_code && next.table == ACCOUNTS_TABLE) {
+            inspace::asset_field value;
+            if (!inspace::account_layout::read<0>(data, size, value)) {
+               return bad_row(path, next);
+            }
+            state.balances.push_back(balance{value.symbol >> 8, next.scope, value.amount});
+         } else if (balances_only) {
+            continue;
+         } else if (next.code == token_code && next.table == STAKE_STATS_TABLE) {
+            inspace::name_field staker;
+            int64_t weight;
+            if (!inspace::stake_stat_layout::read<0>(data, size, staker) || !inspace::stake_stat_layout::read<2>(data, size, weight)) {
+               return bad_row(path, next);
+            }
+            state.stake_stats.push_back(stake_stat{next.scope, staker.value, weight});
+         } else if (next.code == token_code && next.table == STAKE_TOTALS_TABLE) {
+            int64_t weight;
+            if (!inspace::stake_totals_layout::read<1>(data, size, weight)) {
+               return bad_row(path, next);
+            }
+            symbol_state& symbol = state.state_for(next.scope);
+            symbol.has_totals = true;
+            symbol.total_weight = weight;
+         } else if (next.code == token_code && next.table == STAT_TABLE) {
+            inspace::name_field issuer;
+            if (!inspace::currency_stats_layout::read<2>(data, size, issuer)) {
+               return bad_row(path, next);
+            }
+            symbol_state& symbol = state.state_for(next.scope);
+            symbol.has_stats = true;
+            symbol.issuer = issuer.value;
+         } else if (next.code == LIKES_CODE && next.scope == LIKES_CODE && next.table == LIKES_TABLE) {
+            inspace::name_field liker, liked;
+            if (!inspace::like_export_layout::read<1>(data, size, liker) || !inspace::like_export_layout::read<2>(data, size, liked)) {
+               return bad_row(path, next);
+            }
+            state.likes.emplace_back(liker.value, liked.value);
+         }
+      }
+      if (dump.truncated) {
+         fprintf(stderr, "%s: truncated row at the end\n", path.c_str());
+         return false;
+      }
+
+      std::sort(state.balances.begin(), state.balances.end());
+      std::sort(state.stake_stats.begin(), state.stake_stats.end());
+      return true;
+   }
+
+   /*
+
+   the transfer log
+
+   */
+
+   /** an account and an amount. account is the index into the account list, set once every name is known. **/
+   struct entry {
+      uint64_t name;
+      uint32_t account;
+      int64_t amount;
+   };
+
+   struct transfer {
+      uint64_t time;
+      size_t line;
+      uint64_t symbol;
+      entry from;
+      size_t credits_begin, credits_end;   /** into transfer_log::entries **/
+      size_t observed_begin, observed_end;
+      bool has_observed;
+   };
+
+   struct transfer_log {
+      vector<transfer> transfers;
+      vector<entry> entries;
+   };
+
+   /** parses "<account>:<amount>[,...]" onto entries **/
+   bool parse_entries(const string& text, vector<entry>& entries) {
+      std::istringstream list(text);
+      string item;
+      while (std::getline(list, item, ',')) {
+         const size_t colon = item.find(':');
+         if (colon == string::npos) {
+            return false;
+         }
+         entry value{0, 0, 0};
+         char* end = nullptr;
+         const string amount = item.substr(colon + 1);
+         value.amount = strtoll(amount.c_str(), &end, 10);
+         if (amount.empty() || *end != '\0' || !parse_account(item.substr(0, colon), value.name)) {
+            return false;
+         }
+         entries.push_back(value);
+      }
+      return true;
+   }
+
+   bool load_log(const string& path, transfer_log& log) {
+      std::ifstream in(path);
+      if (!in) {
+         fprintf(stderr, "can't read %s\n", path.c_str());
+         return false;
+      }
+
+      string text;
+      for (size_t line = 1; std::getline(in, text); ++line) {
+         if (text.empty() || text[0] == '#') {
+            continue;
+         }
+
+         std::istringstream fields(text);
+         string symbol, from, credits, observed, rest;
+         transfer value{};
+         value.line = line;
+         fields >> value.time >> symbol >> from >> credits >> observed >> rest;
+
+         value.credits_begin = log.entries.size();
+         bool valid = fields.eof() && rest.empty() && symbol_name(symbol, value.symbol) &&
+                      parse_account(from, value.from.name) && parse_entries(credits, log.entries);
+         value.credits_end = log.entries.size();
+         valid = valid && value.credits_end > value.credits_begin;
+
+         value.observed_begin = log.entries.size();
+         value.has_observed = !observed.empty();
+         valid = valid && (!value.has_observed || parse_entries(observed, log.entries));
+         value.observed_end = log.entries.size();
+
+         if (!valid) {
+            fprintf(stderr, "%s:%zu: expected <time> <symbol> <from> <to>:<amount>[,...] [<account>:<delta>[,...]]\n", path.c_str(), line);
+            return false;
+         }
+         for (size_t i = value.credits_begin; i < value.credits_end; ++i) {
+            if (log.entries[i].amount <= 0) {
+               fprintf(stderr, "%s:%zu: transfers must be positive\n", path.c_str(), line);
+               return false;
+            }
+         }
+         log.transfers.push_back(value);
+      }
+      return true;
+   }
+
+   /*
+
+   accounts
+
+   */
+
+   /** every account the audit touches, sorted, so an account is an index into dense arrays **/
+   class account_list {
+      public:
+         void add(uint64_t name) { names.push_back(name); }
+
+         void seal() {
+            std::sort(names.begin(), names.end());
+            names.erase(std::unique(names.begin(), names.end()), names.end());
+         }
+
+         uint32_t index(uint64_t name) const {
+            return uint32_t(std::lower_bound(names.begin(), names.end(), name) - names.begin());
+         }
+
+         uint64_t name(uint32_t index) const { return names[index]; }
+         size_t size() const { return names.size(); }
+
+      private:
+         vector<uint64_t> names;
+   };
+
+   /*
+
+   payouts
+
+   */
+   struct payee {
+      uint32_t account;
+      int64_t weight;
+   };
+
+   /** what the fee of a transfer of one symbol is split by **/
+   struct reward_plan {
+      uint64_t symbol;
+      uint64_t issuer = 0;
+      bool has_stats = false;
+
+      /** without staketotals, distribute() builds it from stakestats first. it pays nothing with a total weight of 0. **/
+      bool has_totals = false;
+      int64_t total_weight = 0;
+      int64_t summed_weight = 0; /** over stakestats, which total_weight should equal **/
+      vector<payee> stakers;
+
+      int64_t likes_weight = 0;
+      vector<payee> liked; /** one per liked account, with the weights of its likers summed **/
+
+      uint32_t inspace;
+   };
+
+   reward_plan make_plan(uint64_t symbol, snapshot& state, const account_list& accounts) {
+      reward_plan plan;
+      plan.symbol = symbol;
+      plan.inspace = accounts.index(INSPACE_ACCOUNT);
+
+      const symbol_state& symbol_info = state.state_for(symbol);
+      plan.has_stats = symbol_info.has_stats;
+      plan.issuer = symbol_info.issuer;
+      plan.has_totals = symbol_info.has_totals;
+      plan.total_weight = symbol_info.total_weight;
+
+      auto begin = std::lower_bound(state.stake_stats.begin(), state.stake_stats.end(), stake_stat{symbol, 0, 0});
+      auto end = begin;
+      for (; end != state.stake_stats.end() && end->symbol == symbol; ++end) {
+         plan.stakers.push_back(payee{accounts.index(end->staker), end->weight});
+         plan.summed_weight += end->weight;
+      }
+
+      /** as load_stake_totals() does on the first transfer **/
+      if (!plan.has_totals) {
+         plan.total_weight = plan.summed_weight;
+      }
+
+      /** a like counts with its liker's weight, if the liker has a stakestats row **/
+      vector<std::pair<uint64_t, int64_t>> liked_weights;
+      for (const auto& like : state.likes) {
+         auto staker = std::lower_bound(begin, end, stake_stat{symbol, like.first, 0});
+         if (staker == end || staker->staker != like.first) {
+            continue;
+         }
+         liked_weights.emplace_back(like.second, staker->weight);
+         plan.likes_weight += staker->weight;
+      }
+      std::sort(liked_weights.begin(), liked_weights.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+      for (const auto& liked : liked_weights) {
+         if (!plan.liked.empty() && accounts.name(plan.liked.back().account) == liked.first) {
+            plan.liked.back().weight += liked.second;
+         } else {
+            plan.liked.push_back(payee{accounts.index(liked.first), liked.second});
+         }
+      }
+      return plan;
+   }
+
+   /** the changes a transfer makes, as sub_balance and add_balance make them **/
+   class payout_calculator {
+      public:
+         explicit payout_calculator(size_t account_count) : deltas(account_count, 0), marks(account_count, false) {}
+
+         void compute(const reward_plan& plan, const transfer& value, const vector<entry>& entries) {
+            int64_t quantity = 0;
+            for (size_t i = value.credits_begin; i < value.credits_end; ++i) {
+               quantity += entries[i].amount;
+               add(entries[i].account, entries[i].amount);
+            }
+
+            const bool no_fee = value.from.name == plan.issuer;
+            const int64_t fee = no_fee ? 0 : policy::apply_bps(quantity, policy::transaction_fee_bps);
+            add(value.from.account, -(quantity + fee));
+            if (no_fee) {
+               return;
+            }
+
+            int64_t remaining = fee;
+
+            /** distribute() **/
+            const int64_t stakers_amount = policy::apply_bps(fee, policy::transaction_fee_to_stakers_bps);
+            if (plan.total_weight != 0) {
+               for (const payee& staker : plan.stakers) {
+                  float proportion = (float)staker.weight / plan.total_weight;
+                  int64_t amount = (int64_t)(stakers_amount * proportion);
+                  add(staker.account, amount);
+                  remaining -= amount;
+               }
+            }
+
+            /** distribute_likes() **/
+            const int64_t likes_amount = policy::apply_bps(fee, policy::transaction_fee_to_likes_bps);
+            if (plan.likes_weight != 0) {
+               for (const payee& liked : plan.liked) {
+                  float proportion = (float)liked.weight / plan.likes_weight;
+                  int64_t amount = (int64_t)(likes_amount * proportion);
+                  add(liked.account, amount);
+                  remaining -= amount;
+               }
+            }
+
+            if (remaining > 0) {
+               add(plan.inspace, remaining);
+            }
+         }
+
+         /** accounts changed by the last compute(), and clears them for the next **/
+         template<typename Visitor>
+         void drain(Visitor&& visit) {
+            for (uint32_t account : touched) {
+               visit(account, deltas[account]);
+               deltas[account] = 0;
+               marks[account] = false;
+            }
+            touched.clear();
+         }
+
+         int64_t delta(uint32_t account) const { return deltas[account]; }
+
+         void add(uint32_t account, int64_t amount) {
+            if (!marks[account]) {
+               marks[account] = true;
+               touched.push_back(account);
+            }
+            deltas[account] += amount;
+         }
+
+      private:
+         vector<int64_t> deltas;
+         vector<bool> marks;
+         vector<uint32_t> touched;
+   };
+
+   /*
+
+   auditing
+
+   */
+   struct divergence {
+      bool found = false;
+      size_t transfer = 0; /** index into transfer_log::transfers **/
+      uint32_t account = 0;
+      int64_t expected = 0;
+      int64_t observed = 0;
+   };
+
+   /** consecutive transfers of one symbol, by time **/
+   struct audit_range {
+      size_t plan;
+      size_t begin, end; /** into the symbol's transfer order **/
+      divergence first;
+   };
+
+   struct symbol_audit {
+      reward_plan plan;
+      vector<size_t> order; /** transfers of the symbol, by time, then by line **/
+      bool all_observed = true;
+   };
+
+   /** per thread totals per account, for each symbol **/
+   struct audit_totals {
+      vector<vector<int64_t>> expected;
+      vector<vector<int64_t>> observed;
+   };
+
+   void audit_ranges(const transfer_log& log, const vector<symbol_audit>& symbols, vector<audit_range>& ranges,
+                     std::atomic<size_t>& next_range, size_t account_count, audit_totals& totals) {
+      payout_calculator expected(account_count);
+      payout_calculator observed(account_count);
+
+      for (size_t index = next_range++; index < ranges.size(); index = next_range++) {
+         audit_range& range = ranges[index];
+         const symbol_audit& symbol = symbols[range.plan];
+         vector<int64_t>& expected_totals = totals.expected[range.plan];
+         vector<int64_t>& observed_totals = totals.observed[range.plan];
+
+         for (size_t i = range.begin; i < range.end; ++i) {
+            const transfer& value = log.transfers[symbol.order[i]];
+            expected.compute(symbol.plan, value, log.entries);
+
+            if (!value.has_observed) {
+               expected.drain([&](uint32_t account, int64_t amount) { expected_totals[account] += amount; });
+               continue;
+            }
+
+            for (size_t entry = value.observed_begin; entry < value.observed_end; ++entry) {
+               observed.add(log.entries[entry].account, log.entries[entry].amount);
+               /** so an account that was expected to change but is not listed gets checked too **/
+               expected.add(log.entries[entry].account, 0);
+            }
+            expected.drain([&](uint32_t account, int64_t amount) {
+               expected_totals[account] += amount;
+               if (!range.first.found && amount != observed.delta(account)) {
+                  range.first = divergence{true, symbol.order[i], account, amount, observed.delta(account)};
+               }
+            });
+            observed.drain([&](uint32_t account, int64_t amount) { observed_totals[account] += amount; });
+         }
+      }
+   }
+
+   struct account_drift {
+      uint64_t account;
+      int64_t expected;
+      int64_t observed;
+
+      int64_t drift() const { return observed - expected; }
+   };
+
+   void report(const symbol_audit& symbol, const audit_range* first, const transfer_log& log, const account_list& accounts,
+               const vector<int64_t>& expected, const vector<int64_t>& observed, bool has_observed, size_t top_count) {
+      const reward_plan& plan = symbol.plan;
+      printf("%s: %zu transfers, %zu stakers, %zu liked accounts\n", symbol_code(plan.symbol).c_str(),
+             symbol.order.size(), plan.stakers.size(), plan.liked.size());
+      if (!plan.has_stats) {
+         printf("   no stat row; transfers are charged a fee whoever sends them\n");
+      }
+      if (!plan.has_totals) {
+         printf("   no staketotals row; the first transfer builds it from stakestats, weight %lld\n", (long long)plan.summed_weight);
+      } else if (plan.total_weight != plan.summed_weight) {
+         printf("   staketotals weight %lld differs from the stakestats sum %lld; stakers are paid by staketotals\n",
+                (long long)plan.total_weight, (long long)plan.summed_weight);
+      }
+
+      if (first != nullptr) {
+         const transfer& value = log.transfers[first->first.transfer];
+         printf("   first divergence: line %zu, time %llu: %s expected %lld, observed %lld\n", value.line,
+                (unsigned long long)value.time, name_to_string(accounts.name(first->first.account)).c_str(),
+                (long long)first->first.expected, (long long)first->first.observed);
+      } else if (symbol.all_observed) {
+         printf("   every transfer matches its logged changes\n");
+      }
+
+      if (!has_observed) {
+         printf("   no observed balances; give -a or log the changes of each transfer\n");
+         return;
+      }
+
+      vector<account_drift> drifts;
+      int64_t total_drift = 0;
+      for (uint32_t account = 0; account < accounts.size(); ++account) {
+         const account_drift drift{accounts.name(account), expected[account], observed[account]};
+         if (drift.drift() != 0) {
+            drifts.push_back(drift);
+            total_drift += drift.drift();
+         }
+      }
+      if (drifts.empty()) {
+         printf("   no drift\n");
+         return;
+      }
+      std::sort(drifts.begin(), drifts.end(), [](const account_drift& a, const account_drift& b) {
+         return std::llabs(a.drift()) > std::llabs(b.drift());
+      });
+
+      printf("   %zu accounts drift, by %lld in total\n", drifts.size(), (long long)total_drift);
+      printf("   %-13s %20s %20s %20s\n", "account", "expected", "observed", "drift");
+      for (size_t i = 0; i < drifts.size() && i < top_count; ++i) {
+         printf("   %-13s %20lld %20lld %20lld\n", name_to_string(drifts[i].account).c_str(),
+                (long long)drifts[i].expected, (long long)drifts[i].observed, (long long)drifts[i].drift());
+      }
+   }
+
+   /** balance changes of one symbol between two snapshots, added to observed **/
+   void balance_changes(uint64_t symbol, const snapshot& before, const snapshot& after, const account_list& accounts,
+                        vector<int64_t>& observed) {
+      auto from = std::lower_bound(before.balances.begin(), before.balances.end(), balance{symbol, 0, 0});
+      for (; from != before.balances.end() && from->symbol == symbol; ++from) {
+         observed[accounts.index(from->owner)] -= from->amount;
+      }
+      auto to = std::lower_bound(after.balances.begin(), after.balances.end(), balance{symbol, 0, 0});
+      for (; to != after.balances.end() && to->symbol == symbol; ++to) {
+         observed[accounts.index(to->owner)] += to->amount;
+      }
+   }
+
+   void usage() {
+      fprintf(stderr, "usage: audit_rewards [-j threads] [-t transfers_per_range] [-c token_contract] [-a after_dump] [-n top] <dump> <transfer log>\n");
+      exit(1);
+   }
+
+} /// namespace
+
+int main(int argc, char** argv) {
+   size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+   size_t transfers_per_range = DEFAULT_TRANSFERS_PER_RANGE;
+   size_t top_count = DEFAULT_TOP_COUNT;
+   uint64_t token_code = string_to_name("iscoin");
+   string after_path;
+
+   int arg = 1;
+   for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+      const long value = atol(argv[arg + 1]);
+      if (strcmp(argv[arg], "-j") == 0 && value > 0) {
+         thread_count = value;
+      } else if (strcmp(argv[arg], "-t") == 0 && value > 0) {
+         transfers_per_range = value;
+      } else if (strcmp(argv[arg], "-n") == 0 && value > 0) {
+         top_count = value;
+      } else if (strcmp(argv[arg], "-c") == 0 && parse_account(argv[arg + 1], token_code)) {
+      } else if (strcmp(argv[arg], "-a") == 0) {
+         after_path = argv[arg + 1];
+      } else {
+         usage();
+      }
+   }
+   if (argc - arg != 2) {
+      usage();
+   }
+
+   snapshot before, after;
+   transfer_log log;
+   if (!load_snapshot(argv[arg], token_code, false, before) || !load_log(argv[arg + 1], log) ||
+       (!after_path.empty() && !load_snapshot(after_path, token_code, true, after))) {
+      return 1;
+   }
+
+   /** number every account, then resolve the names in the log **/
+   account_list accounts;
+   accounts.add(INSPACE_ACCOUNT);
+   for (const balance& value : before.balances) accounts.add(value.owner);
+   for (const balance& value : after.balances) accounts.add(value.owner);
+   for (const stake_stat& value : before.stake_stats) accounts.add(value.staker);
+   for (const auto& like : before.likes) accounts.add(like.second);
+   for (const transfer& value : log.transfers) accounts.add(value.from.name);
+   for (const entry& value : log.entries) accounts.add(value.name);
+   accounts.seal();
+
+   for (transfer& value : log.transfers) value.from.account = accounts.index(value.from.name);
+   for (entry& value : log.entries) value.account = accounts.index(value.name);
+
+   /** a plan per symbol, and its transfers in time order, cut into ranges **/
+   vector<symbol_audit> symbols;
+   for (size_t i = 0; i < log.transfers.size(); ++i) {
+      const uint64_t symbol = log.transfers[i].symbol;
+      auto audit = std::find_if(symbols.begin(), symbols.end(), [&](const symbol_audit& s) { return s.plan.symbol == symbol; });
+      if (audit == symbols.end()) {
+         symbols.push_back(symbol_audit{make_plan(symbol, before, accounts), {}});
+         audit = symbols.end() - 1;
+      }
+      audit->order.push_back(i);
+      audit->all_observed = audit->all_observed && log.transfers[i].has_observed;
+   }
+
+   vector<audit_range> ranges;
+   for (size_t plan = 0; plan < symbols.size(); ++plan) {
+      vector<size_t>& order = symbols[plan].order;
+      std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return log.transfers[a].time < log.transfers[b].time; });
+      for (size_t begin = 0; begin < order.size(); begin += transfers_per_range) {
+         ranges.push_back(audit_range{plan, begin, std::min(order.size(), begin + transfers_per_range), divergence()});
+      }
+   }
+
+   thread_count = std::min(thread_count, std::max<size_t>(1, ranges.size()));
+   vector<audit_totals> totals(thread_count);
+   for (audit_totals& thread_totals : totals) {
+      thread_totals.expected.assign(symbols.size(), vector<int64_t>(accounts.size(), 0));
+      thread_totals.observed.assign(symbols.size(), vector<int64_t>(accounts.size(), 0));
+   }
+
+   std::atomic<size_t> next_range(0);
+   vector<std::thread> threads;
+   for (size_t i = 0; i < thread_count; ++i) {
+      threads.emplace_back(audit_ranges, std::cref(log), std::cref(symbols), std::ref(ranges), std::ref(next_range),
+                           accounts.size(), std::ref(totals[i]));
+   }
+   for (std::thread& thread : threads) {
+      thread.join();
+   }
+
+   for (size_t plan = 0; plan < symbols.size(); ++plan) {
+      vector<int64_t> expected(accounts.size(), 0);
+      vector<int64_t> observed(accounts.size(), 0);
+      for (const audit_totals& thread_totals : totals) {
+         for (size_t account = 0; account < accounts.size(); ++account) {
+            expected[account] += thread_totals.expected[plan][account];
+            observed[account] += thread_totals.observed[plan][account];
+         }
+      }
+
+      /** ranges of a symbol are in time order, so the first one that diverges has the first divergence **/
+      const audit_range* first = nullptr;
+      for (const audit_range& range : ranges) {
+         if (range.plan == plan && range.first.found) {
+            first = &range;
+            break;
+         }
+      }
+
+      const bool has_after = !after_path.empty();
+      if (has_after) {
+         std::fill(observed.begin(), observed.end(), 0);
+         balance_changes(symbols[plan].plan.symbol, before, after, accounts, observed);
+      }
+      report(symbols[plan], first, log, accounts, expected, observed, has_after || symbols[plan].all_observed, top_count);
+   }
+   return 0;
+}
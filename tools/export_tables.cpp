@@ -0,0 +1,507 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Exports a dump of contract table rows to a columnar format, one file per
+ *  table and scope. Rows are decoded with the layouts in
+ *  common/table_layouts.hpp; tables without a layout are exported as raw
+ *  bytes.
+ *
+ *  usage: export_tables [-j threads] [-r rows_per_group] <dump> <output directory>
+ *
+ *  The dump format is described in tables.hpp. Rows of one table and scope
+ *  need not be contiguous, but exporting is fastest when they are.
+ *
+ *  Each output file is <output>/<code>/<table>/<scope>.icol:
+ *
+ *     "ICOLUMN1", uint64 code, uint64 scope, uint64 table,
+ *     varuint32 column count, then per column: varuint32 name length, name, uint8 kind
+ *
+ *  followed by row groups of up to rows_per_group rows:
+ *
+ *     varuint32 row count, then per column: varuint32 byte length, encoded values
+ *
+ *  Column encodings by kind:
+ *
+ *     1 uint   - zigzag varint of the difference from the previous row
+ *     2 name   - varuint32 dictionary size, the names as uint64, then a varuint32 index per row
+ *     3 string - varuint32 length and bytes per row
+ *     4 hash   - per row a uint8 tag, varuint32 length and bytes. tag 1 is lowercase hex and
+ *                tag 2 is base58 (IPFS), both stored decoded; tag 0 is the string as is
+ *     5 blob   - varuint32 length and bytes per row
+ *
+ *  Dictionaries are per row group, so memory stays bounded by the row group
+ *  size and the queue length whatever the size of the dump.
+ */
+#include "tables.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+   using namespace inspace;
+   using namespace inspace::tools;
+
+   /** rows queued per worker before the reader waits **/
+   const size_t QUEUE_LENGTH = 1024;
+
+   const size_t DEFAULT_ROWS_PER_GROUP = 4096;
+
+   /*
+
+   encoding
+
+   */
+   void put_varuint(string& out, uint64_t value) {
+      do {
+         uint8_t byte = value & 0x7f;
+         value >>= 7;
+         out.push_back(char(value ? byte | 0x80 : byte));
+      } while (value);
+   }
+
+   void put_uint64(string& out, uint64_t value) {
+      for (int i = 0; i < 8; ++i) {
+         out.push_back(char(value >> (8 * i)));
+      }
+   }
+
+   void put_bytes(string& out, const string& bytes) {
+      put_varuint(out, bytes.size());
+      out += bytes;
+   }
+
+   bool decode_hex(const string& str, string& bytes) {
+      if (str.empty() || str.size() % 2 != 0) {
+         return false;
+      }
+      bytes.clear();
+      for (size_t i = 0; i < str.size(); i += 2) {
+         int value = 0;
+         for (size_t j = i; j < i + 2; ++j) {
+            const char c = str[j];
+            if (c >= '0' && c <= '9') {
+               value = value * 16 + (c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+               value = value * 16 + (c - 'a' + 10);
+            } else {
+               return false; /** uppercase would not round-trip **/
+            }
+         }
+         bytes.push_back(char(value));
+      }
+      return true;
+   }
+
+   const char* BASE58_ALPHABET = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+   string encode_base58(const string& bytes) {
+      size_t zeros = 0;
+      while (zeros < bytes.size() && bytes[zeros] == 0) {
+         ++zeros;
+      }
+      vector<uint8_t> digits; /** base 58, least significant first **/
+      for (size_t i = zeros; i < bytes.size(); ++i) {
+         uint32_t carry = (uint8_t)bytes[i];
+         for (uint8_t& digit : digits) {
+            carry += uint32_t(digit) << 8;
+            digit = carry % 58;
+            carry /= 58;
+         }
+         for (; carry; carry /= 58) {
+            digits.push_back(carry % 58);
+         }
+      }
+      string str(zeros, '1');
+      for (auto digit = digits.rbegin(); digit != digits.rend(); ++digit) {
+         str.push_back(BASE58_ALPHABET[*digit]);
+      }
+      return str;
+   }
+
+   /** decodes base58 and checks that encoding gives the same string back **/
+   bool decode_base58(const string& str, string& bytes) {
+      if (str.empty()) {
+         return false;
+      }
+      size_t zeros = 0;
+      while (zeros < str.size() && str[zeros] == '1') {
+         ++zeros;
+      }
+      vector<uint8_t> values; /** base 256, least significant first **/
+      for (size_t i = zeros; i < str.size(); ++i) {
+         const char* digit = strchr(BASE58_ALPHABET, str[i]);
+         if (digit == nullptr || str[i] == 0) {
+            return false;
+         }
+         uint32_t carry = uint32_t(digit - BASE58_ALPHABET);
+         for (uint8_t& value : values) {
+            carry += uint32_t(value) * 58;
+            value = carry & 0xff;
+            carry >>= 8;
+         }
+         for (; carry; carry >>= 8) {
+            values.push_back(carry & 0xff);
+         }
+      }
+      bytes.assign(zeros, '\0');
+      bytes.append(values.rbegin(), values.rend());
+      return encode_base58(bytes) == str;
+   }
+
+   void put_hash(string& out, const string& str) {
+      string bytes;
+      if (decode_hex(str, bytes)) {
+         out.push_back(1);
+      } else if (decode_base58(str, bytes)) {
+         out.push_back(2);
+      } else {
+         out.push_back(0);
+         bytes = str;
+      }
+      put_bytes(out, bytes);
+   }
+
+   /** the values of one column in the current row group **/
+   struct column_buffer {
+      vector<uint64_t> numbers; /** uint and name columns **/
+      vector<string> strings;   /** string, hash and blob columns **/
+   };
+
+   void encode_column(const column_def& column, const column_buffer& buffer, string& out) {
+      switch (column.kind) {
+         case column_uint: {
+            uint64_t previous = 0;
+            for (uint64_t value : buffer.numbers) {
+               const int64_t delta = int64_t(value - previous);
+               put_varuint(out, (uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+               previous = value;
+            }
+            break;
+         }
+         case column_name: {
+            vector<uint64_t> dictionary(buffer.numbers);
+            sort(dictionary.begin(), dictionary.end());
+            dictionary.erase(unique(dictionary.begin(), dictionary.end()), dictionary.end());
+            put_varuint(out, dictionary.size());
+            for (uint64_t name : dictionary) {
+               put_uint64(out, name);
+            }
+            for (uint64_t name : buffer.numbers) {
+               put_varuint(out, lower_bound(dictionary.begin(), dictionary.end(), name) - dictionary.begin());
+            }
+            break;
+         }
+         case column_hash:
+            for (const string& value : buffer.strings) {
+               put_hash(out, value);
+            }
+            break;
+         default:
+            for (const string& value : buffer.strings) {
+               put_bytes(out, value);
+            }
+            break;
+      }
+   }
+
+   /*
+
+   decoding rows
+
+   */
+   bool decode_row(const table_schema& schema, uint64_t primary, uint64_t payer, const vector<char>& data, vector<column_buffer>& columns) {
+      columns[0].numbers.push_back(primary);
+      columns[1].numbers.push_back(payer);
+      if (schema.raw) {
+         columns[2].strings.emplace_back(data.begin(), data.end());
+         return true;
+      }
+
+      const char* pos = data.data();
+      const char* end = pos + data.size();
+      for (size_t i = 2; i < schema.columns.size(); ++i) {
+         const column_def& column = schema.columns[i];
+         size_t size = column.size;
+         if (size == 0) {
+            uint32_t length;
+            if (!read_varuint32(pos, end, length)) {
+               return false;
+            }
+            size = length;
+         }
+         if (size_t(end - pos) < size) {
+            return false;
+         }
+         if (column.kind == column_uint || column.kind == column_name) {
+            columns[i].numbers.push_back(load_uint(pos, size, column.is_signed));
+         } else {
+            columns[i].strings.emplace_back(pos, size);
+         }
+         pos += size;
+      }
+      return pos == end;
+   }
+
+   /*
+
+   exporting
+
+   */
+   class row_queue {
+      public:
+         void push(row&& value) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [&] { return rows.size() < QUEUE_LENGTH; });
+            rows.push_back(std::move(value));
+            not_empty.notify_one();
+         }
+
+         /** returns false once the queue is closed and drained **/
+         bool pop(row& value) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [&] { return !rows.empty() || closed; });
+            if (rows.empty()) {
+               return false;
+            }
+            value = std::move(rows.front());
+            rows.pop_front();
+            not_full.notify_one();
+            return true;
+         }
+
+         void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            not_empty.notify_all();
+         }
+
+      private:
+         std::mutex mutex;
+         std::condition_variable not_empty;
+         std::condition_variable not_full;
+         std::deque<row> rows;
+         bool closed = false;
+   };
+
+   /**
+    * Writes the tables and scopes hashed to it. Only one file is open at a
+    * time; when rows of a group come back after another group, its file is
+    * reopened and more row groups are appended.
+    */
+   class export_worker {
+      public:
+         export_worker(const string& output, size_t rows_per_group) : output(output), rows_per_group(rows_per_group) {}
+
+         void run() {
+            row current;
+            while (queue.pop(current)) {
+               if (!open || current.group() != group) {
+                  close_group();
+                  open_group(current);
+               }
+               if (!decode_row(*schema, current.primary, current.payer, current.data, columns)) {
+                  fprintf(stderr, "%s/%s/%s: row %llu does not match its layout, skipped\n",
+                          name_to_string(current.code).c_str(), name_to_string(current.table).c_str(),
+                          name_to_string(current.scope).c_str(), (unsigned long long)current.primary);
+                  discard_partial_row();
+                  ++errors;
+                  continue;
+               }
+               ++row_count;
+               ++rows_exported;
+               if (row_count == rows_per_group) {
+                  write_row_group();
+               }
+            }
+            close_group();
+         }
+
+         row_queue queue;
+         uint64_t rows_exported = 0;
+         uint64_t files_written = 0;
+         uint64_t errors = 0;
+
+      private:
+         typedef std::tuple<uint64_t, uint64_t, uint64_t> group_key;
+
+         void open_group(const row& first) {
+            group = first.group();
+            schema = &schema_for(first.code, first.table);
+            columns.assign(schema->columns.size(), column_buffer());
+            row_count = 0;
+
+            const std::filesystem::path directory = std::filesystem::path(output) / path_name(first.code) / path_name(first.table);
+            const std::filesystem::path path = directory / (path_name(first.scope) + ".icol");
+
+            /** started is kept sorted, so a lookup is a binary search **/
+            auto position = lower_bound(started.begin(), started.end(), group);
+            const bool append = position != started.end() && *position == group;
+            if (!append) {
+               started.insert(position, group);
+               std::filesystem::create_directories(directory);
+               ++files_written;
+            }
+
+            file.open(path, append ? std::ios::binary | std::ios::app : std::ios::binary | std::ios::trunc);
+            if (!file) {
+               fprintf(stderr, "can't write %s\n", path.c_str());
+               exit(1);
+            }
+            open = true;
+
+            if (!append) {
+               string header("ICOLUMN1");
+               put_uint64(header, first.code);
+               put_uint64(header, first.scope);
+               put_uint64(header, first.table);
+               put_varuint(header, schema->columns.size());
+               for (const column_def& column : schema->columns) {
+                  put_bytes(header, column.name);
+                  header.push_back(char(column.kind));
+               }
+               file.write(header.data(), header.size());
+            }
+         }
+
+         void close_group() {
+            if (!open) {
+               return;
+            }
+            write_row_group();
+            file.close();
+            open = false;
+         }
+
+         void write_row_group() {
+            if (row_count == 0) {
+               return;
+            }
+            string block;
+            put_varuint(block, row_count);
+            string encoded;
+            for (size_t i = 0; i < columns.size(); ++i) {
+               encoded.clear();
+               encode_column(schema->columns[i], columns[i], encoded);
+               put_bytes(block, encoded);
+               columns[i].numbers.clear();
+               columns[i].strings.clear();
+            }
+            file.write(block.data(), block.size());
+            row_count = 0;
+         }
+
+         /** drops the values a failed decode_row already appended **/
+         void discard_partial_row() {
+            for (column_buffer& column : columns) {
+               column.numbers.resize(std::min(column.numbers.size(), row_count));
+               column.strings.resize(std::min(column.strings.size(), row_count));
+            }
+         }
+
+         const string output;
+         const size_t rows_per_group;
+
+         bool open = false;
+         group_key group;
+         const table_schema* schema = nullptr;
+         std::ofstream file;
+         vector<column_buffer> columns;
+         size_t row_count = 0;
+         vector<group_key> started;
+   };
+
+   uint64_t group_hash(const row& value) {
+      uint64_t hash = value.code * 0x9e3779b97f4a7c15ull;
+      hash = (hash ^ value.scope) * 0x9e3779b97f4a7c15ull;
+      hash = (hash ^ value.table) * 0x9e3779b97f4a7c15ull;
+      return hash ^ (hash >> 32);
+   }
+
+   void usage() {
+      fprintf(stderr, "usage: export_tables [-j threads] [-r rows_per_group] <dump> <output directory>\n");
+      exit(1);
+   }
+
+} /// namespace
+
+int main(int argc, char** argv) {
+   size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+   size_t rows_per_group = DEFAULT_ROWS_PER_GROUP;
+
+   int arg = 1;
+   for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+      const long value = atol(argv[arg + 1]);
+      if (strcmp(argv[arg], "-j") == 0 && value > 0) {
+         thread_count = value;
+      } else if (strcmp(argv[arg], "-r") == 0 && value > 0) {
+         rows_per_group = value;
+      } else {
+         usage();
+      }
+   }
+   if (argc - arg != 2) {
+      usage();
+   }
+   const string dump_path = argv[arg];
+   const string output = argv[arg + 1];
+
+   dump_reader dump(dump_path);
+   if (!dump.is_open()) {
+      fprintf(stderr, "can't read %s\n", dump_path.c_str());
+      return 1;
+   }
+
+   vector<std::unique_ptr<export_worker>> workers;
+   vector<std::thread> threads;
+   for (size_t i = 0; i < thread_count; ++i) {
+      workers.emplace_back(new export_worker(output, rows_per_group));
+   }
+   for (auto& worker : workers) {
+      threads.emplace_back(&export_worker::run, worker.get());
+   }
+
+   /** one reader hands each table and scope to the same worker **/
+   row next;
+   while (dump.next(next)) {
+      workers[group_hash(next) % workers.size()]->queue.push(std::move(next));
+      next = row();
+   }
+
+   for (auto& worker : workers) {
+      worker->queue.close();
+   }
+   for (std::thread& thread : threads) {
+      thread.join();
+   }
+
+   uint64_t rows = 0, files = 0, errors = 0;
+   for (auto& worker : workers) {
+      rows += worker->rows_exported;
+      files += worker->files_written;
+      errors += worker->errors;
+   }
+   printf("%llu rows, %llu files, %llu rows skipped\n", (unsigned long long)rows, (unsigned long long)files, (unsigned long long)errors);
+
+   if (dump.truncated) {
+      fprintf(stderr, "%s: truncated row at the end\n", dump_path.c_str());
+      return 1;
+   }
+   return errors == 0 ? 0 : 1;
+}
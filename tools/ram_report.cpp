@@ -0,0 +1,361 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Reports the RAM contract tables take, using the layouts in
+ *  common/table_layouts.hpp and the per-row overheads nodeos bills.
+ *
+ *  usage: ram_report [-d dump] [-u users -p profile] [-s string_length]
+ *
+ *  With no options it prints the minimum cost of a row of each table. With a
+ *  dump (see tables.hpp), it prints the bytes actually used per table and
+ *  index, and the scopes and payers that use the most. With -u and -p it
+ *  projects the RAM for that many users, where the profile gives the rows
+ *  per user, e.g. "folders=20,files=200,versions=400,likes=1000". Rows are
+ *  assumed to be the average size seen in the dump, or the minimum size with
+ *  strings of string_length bytes (32 by default) when there is no dump.
+ */
+#include "tables.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+   using namespace inspace::tools;
+
+   /**
+    * Bytes nodeos bills per object, on top of the packed row. These are
+    * config::billable_size_v of the chain objects: a key_value_object row,
+    * a row in each secondary index, and a table_id_object per table and
+    * scope, for the primary table and each secondary index.
+    */
+   const int64_t KEY_VALUE_OVERHEAD = 108;
+   const int64_t INDEX64_OVERHEAD = 128;
+   const int64_t INDEX128_OVERHEAD = 136;
+   const int64_t INDEX256_OVERHEAD = 152;
+   const int64_t TABLE_ID_OVERHEAD = 108;
+
+   const size_t TOP_COUNT = 20;
+
+   int64_t index_overhead(index_kind kind) {
+      switch (kind) {
+         case index64: return INDEX64_OVERHEAD;
+         case index128: return INDEX128_OVERHEAD;
+         default: return INDEX256_OVERHEAD;
+      }
+   }
+
+   const char* index_name(index_kind kind) {
+      switch (kind) {
+         case index64: return "idx64";
+         case index128: return "idx128";
+         default: return "idx256";
+      }
+   }
+
+   /** billed per row besides the packed data **/
+   int64_t row_overhead(const table_schema& schema) {
+      int64_t overhead = KEY_VALUE_OVERHEAD;
+      for (index_kind kind : schema.indexes) {
+         overhead += index_overhead(kind);
+      }
+      return overhead;
+   }
+
+   /** billed once per scope the table has rows in **/
+   int64_t scope_overhead(const table_schema& schema) {
+      return TABLE_ID_OVERHEAD * int64_t(1 + schema.indexes.size());
+   }
+
+   /** tables whose rows are kept in one shared scope, not in each user's **/
+   bool shared_scope(const string& table) {
+      static const char* shared[] = {"likes", "posts", "pullauthors", "requests", "reqcounts", "friendships",
+                                     "likepurges", "likeaudit", "config", "stat", "stakestats", "staketotals"};
+      for (const char* name : shared) {
+         if (table == name) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   /**
+    * Sums of bytes per key. Additions are appended and merged in batches, so
+    * a large dump costs one entry per distinct key, not one per row.
+    */
+   template<typename Key>
+   class flat_totals {
+      public:
+         void add(const Key& key, int64_t bytes) {
+            entries.emplace_back(key, bytes);
+            if (entries.size() >= 2 * merged_size + 4096) {
+               merge();
+            }
+         }
+
+         const vector<std::pair<Key, int64_t>>& totals() {
+            merge();
+            return entries;
+         }
+
+      private:
+         void merge() {
+            std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            size_t out = 0;
+            for (size_t i = 0; i < entries.size(); ++i) {
+               if (out != 0 && entries[out - 1].first == entries[i].first) {
+                  entries[out - 1].second += entries[i].second;
+               } else {
+                  entries[out++] = entries[i];
+               }
+            }
+            entries.resize(out);
+            merged_size = out;
+         }
+
+         vector<std::pair<Key, int64_t>> entries;
+         size_t merged_size = 0;
+   };
+
+   struct table_usage {
+      uint64_t rows = 0;
+      int64_t data_bytes = 0;
+      uint64_t scopes = 0;
+   };
+
+   /** the average packed row of a table, from the dump if it has rows **/
+   double average_row_size(const table_schema& schema, const table_usage* usage, size_t string_length) {
+      if (usage != nullptr && usage->rows != 0) {
+         return double(usage->data_bytes) / double(usage->rows);
+      }
+      size_t size = schema.min_row_size();
+      for (size_t i = 2; i < schema.columns.size(); ++i) {
+         if (schema.columns[i].size == 0) {
+            size += string_length;
+         }
+      }
+      return double(size);
+   }
+
+   string index_list(const table_schema& schema) {
+      string list;
+      for (index_kind kind : schema.indexes) {
+         list += list.empty() ? "" : ",";
+         list += index_name(kind);
+      }
+      return list.empty() ? "-" : list;
+   }
+
+   void print_row_costs() {
+      printf("minimum cost per row (strings empty)\n");
+      printf("   %-14s %8s %10s %-22s %10s %12s\n", "table", "data", "key_value", "indexes", "total", "per scope");
+      for (const table_schema& schema : known_tables()) {
+         const int64_t data = schema.min_row_size();
+         printf("   %-14s %8lld %10lld %-22s %10lld %12lld\n", schema.name.c_str(), (long long)data, (long long)KEY_VALUE_OVERHEAD,
+                index_list(schema).c_str(), (long long)(data + row_overhead(schema)), (long long)scope_overhead(schema));
+      }
+      printf("\n");
+   }
+
+   void print_top(const char* title, vector<std::pair<uint64_t, int64_t>> totals) {
+      std::sort(totals.begin(), totals.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+      printf("%s\n", title);
+      for (size_t i = 0; i < totals.size() && i < TOP_COUNT; ++i) {
+         printf("   %-14s %14lld\n", path_name(totals[i].first).c_str(), (long long)totals[i].second);
+      }
+      printf("\n");
+   }
+
+   /** reads the dump and prints what it uses. fills usage per known table. **/
+   bool report_dump(const string& path, vector<table_usage>& usage) {
+      dump_reader dump(path);
+      if (!dump.is_open()) {
+         fprintf(stderr, "can't read %s\n", path.c_str());
+         return false;
+      }
+
+      const vector<table_schema>& tables = known_tables();
+      typedef std::tuple<uint64_t, uint64_t, uint64_t> group_key;
+      flat_totals<group_key> groups; /** bytes per table and scope **/
+      flat_totals<uint64_t> payers;
+      vector<table_usage> unknown_usage(1);
+
+      row next;
+      while (dump.next(next)) {
+         const table_schema& schema = schema_for(next.code, next.table);
+         const int64_t bytes = int64_t(next.data.size()) + row_overhead(schema);
+         groups.add(next.group(), bytes);
+         payers.add(next.payer, bytes);
+
+         const size_t index = schema.raw ? tables.size() : size_t(&schema - tables.data());
+         table_usage& table = index < tables.size() ? usage[index] : unknown_usage[0];
+         ++table.rows;
+         table.data_bytes += next.data.size();
+      }
+      if (dump.truncated) {
+         fprintf(stderr, "%s: truncated row at the end\n", path.c_str());
+         return false;
+      }
+
+      /** table ids, per scope **/
+      flat_totals<uint64_t> scopes;
+      for (const auto& group : groups.totals()) {
+         const table_schema& schema = schema_for(std::get<0>(group.first), std::get<2>(group.first));
+         scopes.add(std::get<1>(group.first), group.second + scope_overhead(schema));
+         if (!schema.raw) {
+            ++usage[&schema - tables.data()].scopes;
+         } else {
+            ++unknown_usage[0].scopes;
+         }
+      }
+
+      printf("bytes used per table\n");
+      printf("   %-14s %10s %8s %12s %12s %12s %12s %14s\n", "table", "rows", "scopes", "data", "key_value", "indexes", "table ids", "total");
+      int64_t grand_total = 0;
+      auto print_table = [&](const string& name, const table_usage& table, const table_schema& schema) {
+         const int64_t primary = int64_t(table.rows) * KEY_VALUE_OVERHEAD;
+         const int64_t indexes = int64_t(table.rows) * (row_overhead(schema) - KEY_VALUE_OVERHEAD);
+         const int64_t table_ids = int64_t(table.scopes) * scope_overhead(schema);
+         const int64_t total = table.data_bytes + primary + indexes + table_ids;
+         grand_total += total;
+         printf("   %-14s %10llu %8llu %12lld %12lld %12lld %12lld %14lld\n", name.c_str(), (unsigned long long)table.rows,
+                (unsigned long long)table.scopes, (long long)table.data_bytes, (long long)primary, (long long)indexes, (long long)table_ids, (long long)total);
+         for (index_kind kind : schema.indexes) {
+            printf("   %-14s %10s %8s %12s %12s %12lld\n", "", "", "", "", index_name(kind), (long long)(int64_t(table.rows) * index_overhead(kind)));
+         }
+      };
+      for (size_t i = 0; i < tables.size(); ++i) {
+         if (usage[i].rows != 0) {
+            print_table(tables[i].name, usage[i], tables[i]);
+         }
+      }
+      if (unknown_usage[0].rows != 0) {
+         print_table("(other)", unknown_usage[0], schema_for(0, 0));
+      }
+      printf("   %-14s %10s %8s %12s %12s %12s %12s %14lld\n\n", "total", "", "", "", "", "", "", (long long)grand_total);
+
+      print_top("scopes using the most", scopes.totals());
+      print_top("payers billed the most (rows only, table ids are billed to whoever created them)", payers.totals());
+      return true;
+   }
+
+   struct profile_entry {
+      const table_schema* schema;
+      uint64_t rows;
+   };
+
+   bool parse_profile(const string& profile, vector<profile_entry>& entries) {
+      for (size_t pos = 0; pos < profile.size(); ) {
+         size_t end = profile.find(',', pos);
+         if (end == string::npos) {
+            end = profile.size();
+         }
+         const string item = profile.substr(pos, end - pos);
+         const size_t equals = item.find('=');
+         if (equals == string::npos) {
+            fprintf(stderr, "bad profile entry %s\n", item.c_str());
+            return false;
+         }
+         /** table names are unique across the contracts, so the profile leaves out the code **/
+         const table_schema* schema = nullptr;
+         for (const table_schema& known : known_tables()) {
+            if (known.name == item.substr(0, equals)) {
+               schema = &known;
+            }
+         }
+         if (schema == nullptr) {
+            fprintf(stderr, "unknown table %s\n", item.substr(0, equals).c_str());
+            return false;
+         }
+         entries.push_back(profile_entry{schema, strtoull(item.c_str() + equals + 1, nullptr, 10)});
+         pos = end + 1;
+      }
+      return true;
+   }
+
+   void print_projection(uint64_t users, const vector<profile_entry>& profile, const vector<table_usage>& usage, size_t string_length) {
+      const vector<table_schema>& tables = known_tables();
+      printf("projection for %llu users\n", (unsigned long long)users);
+      printf("   %-14s %10s %10s %12s %16s\n", "table", "rows/user", "row bytes", "per user", "total");
+      double per_user_total = 0;
+      double shared_table_ids = 0;
+      for (const profile_entry& entry : profile) {
+         const table_schema& schema = *entry.schema;
+         const table_usage& seen = usage[&schema - tables.data()];
+         const double row_bytes = average_row_size(schema, &seen, string_length) + row_overhead(schema);
+
+         /** tables in the user's scope pay for their table ids in every scope **/
+         double per_user = row_bytes * entry.rows;
+         if (entry.rows != 0) {
+            if (shared_scope(schema.name)) {
+               shared_table_ids += scope_overhead(schema);
+            } else {
+               per_user += scope_overhead(schema);
+            }
+         }
+         per_user_total += per_user;
+         printf("   %-14s %10llu %10.0f %12.0f %16.0f\n", schema.name.c_str(), (unsigned long long)entry.rows, row_bytes, per_user, per_user * users);
+      }
+      const double total = per_user_total * users + shared_table_ids;
+      printf("   %-14s %10s %10s %12.0f %16.0f  (%.1f MiB)\n\n", "total", "", "", per_user_total, total, total / (1024 * 1024));
+   }
+
+   void usage_message() {
+      fprintf(stderr, "usage: ram_report [-d dump] [-u users -p profile] [-s string_length]\n");
+      exit(1);
+   }
+
+} /// namespace
+
+int main(int argc, char** argv) {
+   string dump_path;
+   string profile_text;
+   uint64_t users = 0;
+   size_t string_length = 32;
+
+   for (int arg = 1; arg < argc; arg += 2) {
+      if (arg + 1 >= argc) {
+         usage_message();
+      }
+      if (strcmp(argv[arg], "-d") == 0) {
+         dump_path = argv[arg + 1];
+      } else if (strcmp(argv[arg], "-u") == 0) {
+         users = strtoull(argv[arg + 1], nullptr, 10);
+      } else if (strcmp(argv[arg], "-p") == 0) {
+         profile_text = argv[arg + 1];
+      } else if (strcmp(argv[arg], "-s") == 0) {
+         string_length = strtoull(argv[arg + 1], nullptr, 10);
+      } else {
+         usage_message();
+      }
+   }
+   if ((users != 0) != !profile_text.empty()) {
+      usage_message();
+   }
+
+   vector<profile_entry> profile;
+   if (!profile_text.empty() && !parse_profile(profile_text, profile)) {
+      return 1;
+   }
+
+   print_row_costs();
+
+   vector<table_usage> usage(known_tables().size());
+   if (!dump_path.empty() && !report_dump(dump_path, usage)) {
+      return 1;
+   }
+
+   if (users != 0) {
+      print_projection(users, profile, usage, string_length);
+   }
+   return 0;
+}
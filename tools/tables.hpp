@@ -0,0 +1,345 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  What the native tools know about the contract tables: a schema per table,
+ *  built from the layouts in common/table_layouts.hpp, and a reader for
+ *  dumps of packed rows.
+ *
+ *  A dump is a sequence of rows, each packed as
+ *
+ *     uint64 code, uint64 scope, uint64 table, uint64 primary_key, uint64 payer,
+ *     varuint32 size, size bytes of the packed row
+ *
+ *  with integers in little endian, as in the contract_tables section of a
+ *  chain snapshot.
+ */
+#pragma once
+
+#include "../common/table_layouts.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace inspace { namespace tools {
+
+   using std::string;
+   using std::vector;
+
+   /*
+
+   account names
+
+   */
+   constexpr uint64_t char_to_symbol(char c) {
+      if (c >= 'a' && c <= 'z') {
+         return (c - 'a') + 6;
+      }
+      if (c >= '1' && c <= '5') {
+         return (c - '1') + 1;
+      }
+      return 0;
+   }
+
+   /** same as eosio::string_to_name for names of up to 12 characters, like table names **/
+   constexpr uint64_t string_to_name(const char* str) {
+      uint64_t name = 0;
+      for (int i = 0; str[i] && i < 12; ++i) {
+         name |= (char_to_symbol(str[i]) & 0x1f) << (64 - 5 * (i + 1));
+      }
+      return name;
+   }
+
+   /** same as eosio::name::to_string **/
+   inline string name_to_string(uint64_t value) {
+      static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+      string str(13, '.');
+      uint64_t tmp = value;
+      for (uint32_t i = 0; i <= 12; ++i) {
+         char c = charmap[tmp & (i == 0 ? 0x0f : 0x1f)];
+         str[12 - i] = c;
+         tmp >>= (i == 0 ? 4 : 5);
+      }
+      str.erase(str.find_last_not_of('.') + 1);
+      return str;
+   }
+
+   /** a name as a path component. the empty name would not be one. **/
+   inline string path_name(uint64_t value) {
+      const string str = name_to_string(value);
+      return str.empty() ? "_" : str;
+   }
+
+   /*
+
+   schemas
+
+   */
+   enum column_kind : uint8_t {
+      column_uint = 1,
+      column_name = 2,
+      column_string = 3,
+      column_hash = 4,
+      column_blob = 5
+   };
+
+   struct column_def {
+      string name;
+      column_kind kind;
+      size_t size; /** packed size, or 0 for length-prefixed fields **/
+      bool is_signed;
+   };
+
+   template<typename Field>
+   struct describe_field {
+      static void apply(vector<column_def>& columns, const string& name) {
+         static_assert(std::is_integral<Field>::value, "no column description for this field type");
+         columns.push_back(column_def{name, column_uint, sizeof(Field), std::is_signed<Field>::value});
+      }
+   };
+
+   template<>
+   struct describe_field<name_field> {
+      static void apply(vector<column_def>& columns, const string& name) {
+         columns.push_back(column_def{name, column_name, sizeof(name_field), false});
+      }
+   };
+
+   /** an asset is two columns, so amounts and symbols each compress on their own **/
+   template<>
+   struct describe_field<asset_field> {
+      static void apply(vector<column_def>& columns, const string& name) {
+         columns.push_back(column_def{name + ".amount", column_uint, sizeof(int64_t), true});
+         columns.push_back(column_def{name + ".symbol", column_uint, sizeof(uint64_t), false});
+      }
+   };
+
+   /** a time_point_sec, as seconds since epoch **/
+   template<>
+   struct describe_field<time_field> {
+      static void apply(vector<column_def>& columns, const string& name) {
+         columns.push_back(column_def{name, column_uint, sizeof(time_field), false});
+      }
+   };
+
+   template<>
+   struct describe_field<checksum_field> {
+      static void apply(vector<column_def>& columns, const string& name) {
+         columns.push_back(column_def{name, column_blob, sizeof(checksum_field), false});
+      }
+   };
+
+   template<>
+   struct describe_field<var_string> {
+      static void apply(vector<column_def>& columns, const string& name) {
+         columns.push_back(column_def{name, column_string, 0, false});
+      }
+   };
+
+   template<>
+   struct describe_field<hash_string> {
+      static void apply(vector<column_def>& columns, const string& name) {
+         columns.push_back(column_def{name, column_hash, 0, false});
+      }
+   };
+
+   /** secondary index types, by key size **/
+   enum index_kind : uint8_t {
+      index64,
+      index128,
+      index256
+   };
+
+   /** the accounts the contracts are deployed on. filespace and iscoin read each other's tables at these names. **/
+   constexpr uint64_t FILESPACE_CODE = string_to_name("filespace");
+   constexpr uint64_t FRIENDS_CODE = string_to_name("friends");
+   constexpr uint64_t ISCOIN_CODE = string_to_name("iscoin");
+
+   struct table_schema {
+      uint64_t code;
+      uint64_t table;
+      string name;
+      bool raw; /** no layout: the whole row is one blob column **/
+      vector<column_def> columns; /** primary_key and payer first, then the row's fields **/
+      vector<index_kind> indexes; /** secondary indexes, in declaration order **/
+
+      /** packed size of a row whose strings are all empty **/
+      size_t min_row_size() const {
+         size_t size = 0;
+         for (size_t i = 2; i < columns.size(); ++i) {
+            size += columns[i].size != 0 ? columns[i].size : 1;
+         }
+         return size;
+      }
+   };
+
+   /** builds the schema of a contract's table from its layout, space-separated field names and secondary indexes **/
+   template<typename... Fields>
+   table_schema describe(uint64_t code, const char* table, row_layout<Fields...>, const char* field_names, vector<index_kind> indexes = {}) {
+      vector<string> names;
+      for (const char* pos = field_names; *pos; ) {
+         const char* end = pos + strcspn(pos, " ");
+         names.emplace_back(pos, end);
+         pos = *end ? end + 1 : end;
+      }
+      if (names.size() != sizeof...(Fields)) {
+         fprintf(stderr, "%s: %zu field names for %zu fields\n", table, names.size(), sizeof...(Fields));
+         exit(1);
+      }
+
+      table_schema schema{code, string_to_name(table), table, false, {}, indexes};
+      schema.columns.push_back(column_def{"primary_key", column_uint, sizeof(uint64_t), false});
+      schema.columns.push_back(column_def{"payer", column_name, sizeof(uint64_t), false});
+      size_t i = 0;
+      (void)std::initializer_list<int>{(describe_field<Fields>::apply(schema.columns, names[i++]), 0)...};
+      return schema;
+   }
+
+   /** keep in step with the tables' typedefs in the contracts **/
+   inline const vector<table_schema>& known_tables() {
+      static const vector<table_schema> tables = {
+         describe(FILESPACE_CODE, "folders", folder_layout(), "id name parent_folder", {index64}),
+         describe(FILESPACE_CODE, "files", file_layout(), "id name parent_folder current_version", {index64}),
+         describe(FILESPACE_CODE, "versions", version_layout(), "id ipfs_hash sha256 date file key", {index64, index64}),
+         describe(FILESPACE_CODE, "likes", like_export_layout(), "id liker liked version", {index128}),
+         describe(FILESPACE_CODE, "profiles", profile_layout(), "id ipfs_hash key"),
+         describe(FILESPACE_CODE, "keys", key_layout(), "id iv version_count"),
+         describe(FILESPACE_CODE, "enckeys", enc_key_layout(), "id key public_key iv nonce value", {index64, index64}),
+         describe(FILESPACE_CODE, "posts", post_layout(), "id account is_folder subject caption date", {index64}),
+         describe(FILESPACE_CODE, "inbox", inbox_layout(), "id post_id author date"),
+         describe(FILESPACE_CODE, "pullauthors", pull_author_layout(), "account"),
+         describe(FILESPACE_CODE, "folderhashes", folder_hash_layout(), "id hash"),
+         describe(FILESPACE_CODE, "roothash", root_hash_layout(), "hash"),
+         describe(FILESPACE_CODE, "grants", grant_layout(), "id folder grantee rights", {index128}),
+         describe(FILESPACE_CODE, "shares", share_layout(), "id owner folder rights", {index128}),
+         describe(FILESPACE_CODE, "aclsummary", acl_summary_layout(), "folder rights grant_count"),
+         describe(FILESPACE_CODE, "usage", usage_layout(), "folders folder_bytes files file_bytes versions version_bytes keys key_bytes enckeys enckey_bytes"),
+         describe(FILESPACE_CODE, "usagerecount", usage_recount_layout(), "phase next folders folder_bytes files file_bytes versions version_bytes keys key_bytes enckeys enckey_bytes"),
+         describe(FILESPACE_CODE, "config", config_layout(), "max_folders max_files max_versions max_keys max_enckeys max_bytes user_pays_ram"),
+         describe(FILESPACE_CODE, "likepurges", like_purge_layout(), "id liked version"),
+         describe(FILESPACE_CODE, "likeaudit", like_audit_layout(), "next_id"),
+         describe(FILESPACE_CODE, "likereindex", like_reindex_layout(), "next_id done"),
+         describe(FILESPACE_CODE, "nameindex", name_token_layout(), "id token kind target", {index64, index128}),
+         describe(FILESPACE_CODE, "clonejob", clone_job_layout(), "source target id_offset copied"),
+         describe(FILESPACE_CODE, "clonequeue", clone_queue_layout(), "id source target last_child phase"),
+         describe(FILESPACE_CODE, "versionrefs", version_ref_layout(), "version refs"),
+         describe(FILESPACE_CODE, "sharedvers", shared_version_layout(), "file version"),
+         describe(FILESPACE_CODE, "keymigration", key_migration_layout(), "phase next"),
+         describe(FILESPACE_CODE, "namereindex", name_reindex_layout(), "phase next"),
+         describe(FILESPACE_CODE, "postreindex", post_reindex_layout(), "next_id done"),
+         describe(FRIENDS_CODE, "requests", request_layout(), "id from to created", {index64, index64, index64}),
+         describe(FRIENDS_CODE, "reqcounts", request_count_layout(), "from count"),
+         describe(FRIENDS_CODE, "reqreindex", request_reindex_layout(), "phase next"),
+         describe(FRIENDS_CODE, "friendships", friendship_layout(), "id account1 account2", {index64, index64}),
+         describe(ISCOIN_CODE, "accounts", account_layout(), "balance"),
+         describe(ISCOIN_CODE, "stat", currency_stats_layout(), "supply max_supply issuer"),
+         describe(ISCOIN_CODE, "stakes", stake_layout(), "id quantity start duration"),
+         describe(ISCOIN_CODE, "stakestats", stake_stat_layout(), "staker total_stake stake_weight", {index64}),
+         describe(ISCOIN_CODE, "staketotals", stake_totals_layout(), "total_stake total_weight")
+      };
+      return tables;
+   }
+
+   /** the schema of a contract's table, or a raw one for tables without a layout. other contracts' tables of the same name are raw too. **/
+   inline const table_schema& schema_for(uint64_t code, uint64_t table) {
+      for (const table_schema& schema : known_tables()) {
+         if (schema.code == code && schema.table == table) {
+            return schema;
+         }
+      }
+      static const table_schema raw_schema{0, 0, "", true, {
+         column_def{"primary_key", column_uint, sizeof(uint64_t), false},
+         column_def{"payer", column_name, sizeof(uint64_t), false},
+         column_def{"data", column_blob, 0, false}
+      }, {}};
+      return raw_schema;
+   }
+
+   inline uint64_t load_uint(const char* pos, size_t size, bool is_signed) {
+      uint64_t value = 0;
+      memcpy(&value, pos, size);
+      if (is_signed && size < 8 && (value >> (8 * size - 1)) & 1) {
+         value |= ~uint64_t(0) << (8 * size);
+      }
+      return value;
+   }
+
+   /*
+
+   dumps
+
+   */
+   struct row {
+      uint64_t code;
+      uint64_t scope;
+      uint64_t table;
+      uint64_t primary;
+      uint64_t payer;
+      vector<char> data;
+
+      std::tuple<uint64_t, uint64_t, uint64_t> group() const { return std::make_tuple(code, scope, table); }
+   };
+
+   /** reads a dump row by row **/
+   class dump_reader {
+      public:
+         explicit dump_reader(const string& path) : in(path, std::ios::binary) {}
+
+         bool is_open() const { return bool(in); }
+
+         /** false at the end of the dump, or at a truncated row **/
+         bool next(row& value) {
+            if (!read_uint64(value.code)) {
+               return false;
+            }
+            uint32_t size = 0;
+            if (!read_uint64(value.scope) || !read_uint64(value.table) || !read_uint64(value.primary) ||
+                !read_uint64(value.payer) || !read_varuint32(size)) {
+               truncated = true;
+               return false;
+            }
+            value.data.resize(size);
+            if (size != 0 && !in.read(value.data.data(), size)) {
+               truncated = true;
+               return false;
+            }
+            return true;
+         }
+
+         bool truncated = false;
+
+      private:
+         bool read_uint64(uint64_t& value) {
+            char bytes[8];
+            if (!in.read(bytes, 8)) {
+               return false;
+            }
+            value = load_uint(bytes, 8, false);
+            return true;
+         }
+
+         bool read_varuint32(uint32_t& value) {
+            value = 0;
+            for (uint32_t shift = 0; shift < 35; shift += 7) {
+               const int byte = in.get();
+               if (byte == EOF) {
+                  return false;
+               }
+               value |= uint32_t(byte & 0x7f) << shift;
+               if ((byte & 0x80) == 0) {
+                  return true;
+               }
+            }
+            return false;
+         }
+
+         std::ifstream in;
+   };
+
+} } /// namespace inspace::tools
@@ -0,0 +1,578 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Generates deterministic action traces and replays them against a local
+ *  node, to see how the cost of each action grows with the state it works on.
+ *
+ *  usage:
+ *     workload generate <scenario> <actions> [seed] [time_unit] > trace.txt
+ *     workload replay [-c cleos command] [-k public key] trace.txt > samples.csv
+ *     workload report samples.csv
+ *
+ *  Scenarios:
+ *
+ *     tree     one account builds a deep and wide folder tree, adding files and versions
+ *     churn    versions are added to a few popular files, which are deleted and re-added
+ *     stakes   many stakers with mixed durations, then transfers that pay out to them
+ *     likes    versions liked with a power-law popularity, then transfers that pay out to likes
+ *     friends  friend requests with power-law degrees, most of them accepted
+ *
+ *  A trace has one action per line:
+ *
+ *     <n> <contract> <action> <actor> <json arguments>
+ *
+ *  where n is the size of the state the action has to look at, e.g. the
+ *  folder's children for addfolder or the number of stakers for transfer.
+ *  "- newaccount <name>" lines create the accounts the trace uses. The same
+ *  scenario, size and seed always give the same trace.
+ *
+ *  replay pushes each action with cleos and records the CPU time and
+ *  elapsed time billed in the receipt, and the RAM it used. The contracts
+ *  must be deployed on the accounts filespace, iscoin and friends, and the
+ *  wallet must hold the key given with -k. Stake durations are counted in
+ *  time_unit seconds, 86400 by default; use 60 with the iscoin test build.
+ *
+ *  report groups the samples per action into buckets of n and fits the
+ *  growth of the median CPU time against n. An action whose cost grows with
+ *  n makes the total cost of n actions super-linear; those are flagged.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+   /** growth exponent from which an action is flagged **/
+   const double FLAG_SLOPE = 0.5;
+
+   /*
+
+   deterministic randomness
+
+   */
+   class random_source {
+      public:
+         explicit random_source(uint64_t seed) : state(seed) {}
+
+         /** splitmix64, so traces do not depend on the standard library's engines **/
+         uint64_t next() {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+         }
+
+         /** uniform in [0, count) **/
+         uint64_t uniform(uint64_t count) { return next() % count; }
+
+         bool chance(uint32_t percent) { return uniform(100) < percent; }
+
+         /** in [0, count), with density falling as 1/(i+1), so a few items get most picks **/
+         uint64_t power_law(uint64_t count) {
+            const double u = double(next() >> 11) / double(1ull << 53);
+            const uint64_t rank = uint64_t(std::exp(u * std::log(double(count) + 1))) - 1;
+            return std::min(rank, count - 1);
+         }
+
+      private:
+         uint64_t state;
+   };
+
+   /** a valid account name for index i: "wl" and up to 10 more letters **/
+   string account(const char* prefix, uint64_t i) {
+      string name = prefix;
+      do {
+         name.push_back(char('a' + i % 26));
+         i /= 26;
+      } while (i && name.size() < 12);
+      return name;
+   }
+
+   /** a fake IPFS hash and sha256 that differ per version **/
+   string ipfs_hash(uint64_t version) {
+      static const char* alphabet = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+      string hash = "Qm";
+      uint64_t value = version * 0x9e3779b97f4a7c15ull;
+      for (int i = 0; i < 44; ++i) {
+         hash.push_back(alphabet[value % 58]);
+         value = value / 58 + (uint64_t(i + 1) * 0x2545f4914f6cdd1dull);
+      }
+      return hash;
+   }
+
+   string sha256(uint64_t version) {
+      char buffer[65];
+      for (int i = 0; i < 4; ++i) {
+         snprintf(buffer + 16 * i, 17, "%016llx", (unsigned long long)(version * 0x9e3779b97f4a7c15ull + i));
+      }
+      return string(buffer, 64);
+   }
+
+   string quantity(uint64_t units) {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), "%llu.0000 ISC", (unsigned long long)units);
+      return buffer;
+   }
+
+   /*
+
+   generating
+
+   */
+   class trace_writer {
+      public:
+         void new_account(const string& name) {
+            printf("- newaccount %s\n", name.c_str());
+         }
+
+         /** fields are name/value pairs; values are written as they are, so strings carry their quotes **/
+         void action(uint64_t n, const char* contract, const char* name, const string& actor, const vector<std::pair<const char*, string>>& fields) {
+            string json = "{";
+            for (const auto& field : fields) {
+               if (json.size() > 1) {
+                  json += ",";
+               }
+               json += "\"" + string(field.first) + "\":" + field.second;
+            }
+            json += "}";
+            printf("%llu %s %s %s %s\n", (unsigned long long)n, contract, name, actor.c_str(), json.c_str());
+         }
+   };
+
+   string quoted(const string& value) { return "\"" + value + "\""; }
+   string number(uint64_t value) { return std::to_string(value); }
+
+   void generate_tree(trace_writer& out, random_source& random, uint64_t actions) {
+      const string user = account("wltree", 0);
+      out.new_account(user);
+
+      vector<uint64_t> children(1, 0); /** per folder id; 0 is the root **/
+      uint64_t next_id = 1;
+      for (uint64_t i = 0; i < actions; ++i) {
+         /** mostly old folders, which makes them wide, and sometimes the newest, which makes the tree deep **/
+         const uint64_t parent = random.chance(20) ? children.size() - 1 : random.power_law(children.size());
+         const string name = quoted("n" + number(next_id));
+
+         if (random.chance(30)) {
+            out.action(children[parent], "filespace", "addfolder", user, {{"user", quoted(user)}, {"id", number(children.size())}, {"name", name}, {"parent_folder", number(parent)}});
+            children.push_back(0);
+         } else {
+            const uint64_t file = next_id + 1000000000;
+            out.action(children[parent], "filespace", "addfile", user, {{"user", quoted(user)}, {"id", number(file)}, {"name", name}, {"parent_folder", number(parent)}, {"current_version", "0"}});
+            out.action(0, "filespace", "addversion", user, {{"user", quoted(user)}, {"id", number(file)}, {"ipfs_hash", quoted(ipfs_hash(file))}, {"sha256", quoted(sha256(file))}, {"date", number(i)}, {"file", number(file)}, {"key", "0"}});
+         }
+         ++children[parent];
+         ++next_id;
+      }
+   }
+
+   void generate_churn(trace_writer& out, random_source& random, uint64_t actions) {
+      const string user = account("wlchurn", 0);
+      out.new_account(user);
+      out.action(0, "filespace", "addfolder", user, {{"user", quoted(user)}, {"id", "1"}, {"name", quoted("churn")}, {"parent_folder", "0"}});
+
+      const uint64_t file_count = 16;
+      vector<uint64_t> versions(file_count, 0);
+      vector<uint64_t> generation(file_count, 0);
+      uint64_t next_version = 1;
+      for (uint64_t i = 0; i < actions; ++i) {
+         const uint64_t slot = random.power_law(file_count);
+         const uint64_t file = 1000 + slot + generation[slot] * file_count;
+
+         if (versions[slot] == 0) {
+            out.action(0, "filespace", "addfile", user, {{"user", quoted(user)}, {"id", number(file)}, {"name", quoted("f" + number(file))}, {"parent_folder", "1"}, {"current_version", "0"}});
+         }
+
+         if (versions[slot] > 0 && random.chance(2)) {
+            out.action(versions[slot], "filespace", "deletefile", user, {{"user", quoted(user)}, {"id", number(file)}});
+            versions[slot] = 0;
+            ++generation[slot];
+            continue;
+         }
+
+         const uint64_t version = next_version++;
+         out.action(versions[slot], "filespace", "addversion", user, {{"user", quoted(user)}, {"id", number(version)}, {"ipfs_hash", quoted(ipfs_hash(version))}, {"sha256", quoted(sha256(version))}, {"date", number(i)}, {"file", number(file)}, {"key", "0"}});
+         ++versions[slot];
+      }
+   }
+
+   /** creates the token, returns the issuer **/
+   string create_token(trace_writer& out) {
+      const string issuer = account("wlissuer", 0);
+      out.new_account(issuer);
+      out.action(0, "iscoin", "create", "iscoin", {{"issuer", quoted(issuer)}, {"maximum_supply", quoted(quantity(1000000000))}});
+      return issuer;
+   }
+
+   void generate_stakes(trace_writer& out, random_source& random, uint64_t actions, uint64_t time_unit) {
+      static const uint64_t tier_days[] = {0, 30, 90, 180, 360};
+      const string issuer = create_token(out);
+
+      /** half the actions add stakers, the other half transfer between them **/
+      vector<string> stakers;
+      for (uint64_t i = 0; i < actions; ++i) {
+         if (i % 2 == 0) {
+            const string staker = account("wlstake", stakers.size());
+            out.new_account(staker);
+            out.action(stakers.size(), "iscoin", "issue", issuer, {{"to", quoted(staker)}, {"quantity", quoted(quantity(1000))}, {"memo", quoted("")}});
+            const uint64_t days = tier_days[random.uniform(5)] + random.uniform(30);
+            out.action(stakers.size(), "iscoin", "addstake", staker, {{"staker", quoted(staker)}, {"quantity", quoted(quantity(1 + random.uniform(500)))}, {"duration", number(days * time_unit)}});
+            stakers.push_back(staker);
+         } else {
+            const string& from = stakers[random.power_law(stakers.size())];
+            const string& to = stakers[random.uniform(stakers.size())];
+            out.action(stakers.size(), "iscoin", "transfer", from, {{"from", quoted(from)}, {"to", quoted(to)}, {"quantity", quoted(quantity(1))}, {"memo", quoted(number(i))}});
+         }
+      }
+   }
+
+   void generate_likes(trace_writer& out, random_source& random, uint64_t actions) {
+      const string issuer = create_token(out);
+
+      const uint64_t user_count = 32;
+      vector<string> users;
+      for (uint64_t i = 0; i < user_count; ++i) {
+         users.push_back(account("wlliker", i));
+         out.new_account(users.back());
+         out.action(0, "iscoin", "issue", issuer, {{"to", quoted(users.back())}, {"quantity", quoted(quantity(100000))}, {"memo", quoted("")}});
+         out.action(0, "filespace", "addfolder", users.back(), {{"user", quoted(users.back())}, {"id", "1"}, {"name", quoted("likes")}, {"parent_folder", "0"}});
+      }
+
+      vector<std::pair<uint64_t, uint64_t>> versions; /** user index and version id **/
+      uint64_t like_count = 0;
+      for (uint64_t i = 0; i < actions; ++i) {
+         const uint64_t choice = random.uniform(10);
+         if (choice < 2 || versions.empty()) {
+            const uint64_t owner = random.uniform(user_count);
+            const uint64_t id = versions.size() + 1;
+            const string& user = users[owner];
+            out.action(0, "filespace", "addfile", user, {{"user", quoted(user)}, {"id", number(id)}, {"name", quoted("f" + number(id))}, {"parent_folder", "1"}, {"current_version", "0"}});
+            out.action(0, "filespace", "addversion", user, {{"user", quoted(user)}, {"id", number(id)}, {"ipfs_hash", quoted(ipfs_hash(id))}, {"sha256", quoted(sha256(id))}, {"date", number(i)}, {"file", number(id)}, {"key", "0"}});
+            versions.emplace_back(owner, id);
+         } else if (choice < 7) {
+            /** the first versions are the popular ones **/
+            const auto& liked = versions[random.power_law(versions.size())];
+            const string& user = users[random.uniform(user_count)];
+            out.action(like_count, "filespace", "addlike", user, {{"user", quoted(user)}, {"id", number(++like_count)}, {"liked", quoted(users[liked.first])}, {"version", number(liked.second)}});
+         } else {
+            const string& from = users[random.uniform(user_count)];
+            const string& to = users[random.uniform(user_count)];
+            out.action(like_count, "iscoin", "transfer", from, {{"from", quoted(from)}, {"to", quoted(to)}, {"quantity", quoted(quantity(1))}, {"memo", quoted(number(i))}});
+         }
+      }
+   }
+
+   void generate_friends(trace_writer& out, random_source& random, uint64_t actions) {
+      const uint64_t user_count = std::max<uint64_t>(16, actions / 8);
+      vector<string> users;
+      for (uint64_t i = 0; i < user_count; ++i) {
+         users.push_back(account("wlfriend", i));
+         out.new_account(users.back());
+      }
+
+      /** links per user, and the pairs already linked or requested, kept sorted **/
+      vector<uint64_t> degree(user_count, 0);
+      vector<std::pair<uint64_t, uint64_t>> linked;
+      for (uint64_t i = 0; i < actions; ++i) {
+         const uint64_t from = random.power_law(user_count);
+         const uint64_t to = random.uniform(user_count);
+         const auto pair = std::make_pair(std::min(from, to), std::max(from, to));
+         auto position = std::lower_bound(linked.begin(), linked.end(), pair);
+         if (from == to || (position != linked.end() && *position == pair)) {
+            continue;
+         }
+         linked.insert(position, pair);
+
+         out.action(degree[from] + degree[to], "friends", "addrequest", users[from], {{"user", quoted(users[from])}, {"to", quoted(users[to])}});
+         if (random.chance(70)) {
+            out.action(degree[from] + degree[to], "friends", "addrequest", users[to], {{"user", quoted(users[to])}, {"to", quoted(users[from])}});
+         }
+         ++degree[from];
+         ++degree[to];
+      }
+   }
+
+   int generate(int argc, char** argv) {
+      if (argc < 2) {
+         return -1;
+      }
+      const string scenario = argv[0];
+      const uint64_t actions = strtoull(argv[1], nullptr, 10);
+      random_source random(argc > 2 ? strtoull(argv[2], nullptr, 10) : 1);
+      const uint64_t time_unit = argc > 3 ? strtoull(argv[3], nullptr, 10) : 86400;
+
+      trace_writer out;
+      if (scenario == "tree") {
+         generate_tree(out, random, actions);
+      } else if (scenario == "churn") {
+         generate_churn(out, random, actions);
+      } else if (scenario == "stakes") {
+         generate_stakes(out, random, actions, time_unit);
+      } else if (scenario == "likes") {
+         generate_likes(out, random, actions);
+      } else if (scenario == "friends") {
+         generate_friends(out, random, actions);
+      } else {
+         fprintf(stderr, "unknown scenario %s\n", scenario.c_str());
+         return 1;
+      }
+      return 0;
+   }
+
+   /*
+
+   replaying
+
+   */
+   string run(const string& command, int& status) {
+      string output;
+      FILE* pipe = popen((command + " 2>&1").c_str(), "r");
+      if (pipe == nullptr) {
+         status = -1;
+         return output;
+      }
+      char buffer[4096];
+      size_t size;
+      while ((size = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+         output.append(buffer, size);
+      }
+      status = pclose(pipe);
+      return output;
+   }
+
+   /** the number after the first "key": at or after from. returns false if there is none. **/
+   bool json_number(const string& json, const string& key, size_t& from, int64_t& value) {
+      const size_t position = json.find("\"" + key + "\":", from);
+      if (position == string::npos) {
+         return false;
+      }
+      from = position + key.size() + 3;
+      value = strtoll(json.c_str() + from, nullptr, 10);
+      return true;
+   }
+
+   int replay(int argc, char** argv) {
+      string cleos = "cleos";
+      string public_key;
+      int arg = 0;
+      for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+         if (strcmp(argv[arg], "-c") == 0) {
+            cleos = argv[arg + 1];
+         } else if (strcmp(argv[arg], "-k") == 0) {
+            public_key = argv[arg + 1];
+         } else {
+            return -1;
+         }
+      }
+      if (argc - arg != 1) {
+         return -1;
+      }
+
+      std::ifstream trace(argv[arg]);
+      if (!trace) {
+         fprintf(stderr, "can't read %s\n", argv[arg]);
+         return 1;
+      }
+
+      printf("action,n,cpu_usage_us,elapsed_us,ram_bytes\n");
+      uint64_t failures = 0;
+      string line;
+      while (std::getline(trace, line)) {
+         std::istringstream fields(line);
+         string n, contract, action, actor, json;
+         fields >> n >> contract >> action;
+
+         int status;
+         if (n == "-") {
+            if (action == "newaccount") {
+               fields >> actor;
+               if (public_key.empty()) {
+                  fprintf(stderr, "the trace creates accounts; give their key with -k\n");
+                  return 1;
+               }
+               run(cleos + " create account eosio " + actor + " " + public_key + " " + public_key, status);
+            }
+            continue;
+         }
+
+         fields >> actor >> std::ws;
+         std::getline(fields, json);
+         const string output = run(cleos + " push action " + contract + " " + action + " '" + json + "' -p " + actor + "@active -j", status);
+
+         size_t from = 0;
+         int64_t cpu, elapsed;
+         if (status != 0 || !json_number(output, "cpu_usage_us", from, cpu) || !json_number(output, "elapsed", from, elapsed)) {
+            fprintf(stderr, "failed: %s\n%s\n", line.c_str(), output.c_str());
+            ++failures;
+            continue;
+         }
+
+         /** RAM used by every account the action charged **/
+         int64_t ram = 0, delta;
+         while (json_number(output, "delta", from, delta)) {
+            ram += delta;
+         }
+
+         printf("%s::%s,%s,%lld,%lld,%lld\n", contract.c_str(), action.c_str(), n.c_str(), (long long)cpu, (long long)elapsed, (long long)ram);
+         fflush(stdout);
+      }
+
+      if (failures != 0) {
+         fprintf(stderr, "%llu actions failed\n", (unsigned long long)failures);
+         return 1;
+      }
+      return 0;
+   }
+
+   /*
+
+   reporting
+
+   */
+   struct sample {
+      string action;
+      uint64_t n;
+      double cpu;
+      double elapsed;
+      double ram;
+
+      bool operator<(const sample& other) const { return action != other.action ? action < other.action : n < other.n; }
+   };
+
+   double median(vector<double>& values) {
+      std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+      return values[values.size() / 2];
+   }
+
+   /** bucket of n: 0, then powers of two **/
+   uint32_t bucket_of(uint64_t n) {
+      uint32_t bucket = 0;
+      while (n) {
+         ++bucket;
+         n >>= 1;
+      }
+      return bucket;
+   }
+
+   void report_action(vector<sample>::const_iterator begin, vector<sample>::const_iterator end) {
+      printf("%s\n", begin->action.c_str());
+      printf("   %-16s %8s %12s %12s %10s\n", "n", "samples", "cpu_us", "elapsed_us", "ram_bytes");
+
+      /** least squares of log(cpu) against log(n), over the buckets with n > 0 **/
+      double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+      uint32_t points = 0;
+
+      for (auto bucket_begin = begin; bucket_begin != end; ) {
+         const uint32_t bucket = bucket_of(bucket_begin->n);
+         auto bucket_end = bucket_begin;
+         vector<double> cpu, elapsed, ram;
+         while (bucket_end != end && bucket_of(bucket_end->n) == bucket) {
+            cpu.push_back(bucket_end->cpu);
+            elapsed.push_back(bucket_end->elapsed);
+            ram.push_back(bucket_end->ram);
+            ++bucket_end;
+         }
+
+         const uint64_t low = bucket == 0 ? 0 : 1ull << (bucket - 1);
+         const uint64_t high = bucket == 0 ? 0 : (1ull << bucket) - 1;
+         const double cpu_median = median(cpu);
+         char range[40];
+         snprintf(range, sizeof(range), "%llu-%llu", (unsigned long long)low, (unsigned long long)high);
+         printf("   %-16s %8zu %12.0f %12.0f %10.0f\n", range, cpu.size(), cpu_median, median(elapsed), median(ram));
+
+         if (bucket != 0 && cpu_median > 0) {
+            const double x = std::log(double(low + high) / 2);
+            const double y = std::log(cpu_median);
+            sum_x += x;
+            sum_y += y;
+            sum_xx += x * x;
+            sum_xy += x * y;
+            ++points;
+         }
+         bucket_begin = bucket_end;
+      }
+
+      if (points < 3 || sum_xx * points == sum_x * sum_x) {
+         printf("   growth: not enough sizes to fit\n\n");
+         return;
+      }
+      const double slope = (points * sum_xy - sum_x * sum_y) / (points * sum_xx - sum_x * sum_x);
+      printf("   growth: cpu ~ n^%.2f%s\n\n", slope, slope >= FLAG_SLOPE ? "  <-- grows with n: super-linear over n actions" : "");
+   }
+
+   int report(int argc, char** argv) {
+      if (argc != 1) {
+         return -1;
+      }
+      std::ifstream input(argv[0]);
+      if (!input) {
+         fprintf(stderr, "can't read %s\n", argv[0]);
+         return 1;
+      }
+
+      vector<sample> samples;
+      string line;
+      std::getline(input, line); /** header **/
+      while (std::getline(input, line)) {
+         sample s;
+         char action[128];
+         unsigned long long n;
+         if (sscanf(line.c_str(), "%127[^,],%llu,%lf,%lf,%lf", action, &n, &s.cpu, &s.elapsed, &s.ram) == 5) {
+            s.action = action;
+            s.n = n;
+            samples.push_back(s);
+         }
+      }
+      std::sort(samples.begin(), samples.end());
+
+      for (auto begin = samples.cbegin(); begin != samples.cend(); ) {
+         auto end = begin;
+         while (end != samples.cend() && end->action == begin->action) {
+            ++end;
+         }
+         report_action(begin, end);
+         begin = end;
+      }
+      return 0;
+   }
+
+   void usage() {
+      fprintf(stderr,
+              "usage: workload generate <tree|churn|stakes|likes|friends> <actions> [seed] [time_unit]\n"
+              "       workload replay [-c cleos command] [-k public key] <trace>\n"
+              "       workload report <samples>\n");
+      exit(1);
+   }
+
+} /// namespace
+
+int main(int argc, char** argv) {
+   if (argc < 2) {
+      usage();
+   }
+   const string command = argv[1];
+   int result = -1;
+   if (command == "generate") {
+      result = generate(argc - 2, argv + 2);
+   } else if (command == "replay") {
+      result = replay(argc - 2, argv + 2);
+   } else if (command == "report") {
+      result = report(argc - 2, argv + 2);
+   }
+   if (result < 0) {
+      usage();
+   }
+   return result;
+}